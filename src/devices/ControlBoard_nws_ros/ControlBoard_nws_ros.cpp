@@ -13,6 +13,11 @@
 
 #include <yarp/rosmsg/impl/yarpRosHelper.h>
 
+#include <yarp/os/SystemClock.h>
+#include <yarp/os/Time.h>
+
+#include <algorithm>
+#include <cmath>
 #include <numeric>
 
 using namespace yarp::os;
@@ -34,7 +39,16 @@ void ControlBoard_nws_ros::closePorts()
     publisherPort.interrupt();
     publisherPort.close();
 
-    delete node;
+    if (!skewTopicName.empty()) {
+        skewPublisher.interrupt();
+        skewPublisher.close();
+    }
+
+    if (sharedNode) {
+        RosNodeRegistry::release(node);
+    } else {
+        delete node;
+    }
     node = nullptr;
 }
 
@@ -57,6 +71,67 @@ bool ControlBoard_nws_ros::open(Searchable& config)
     Property prop;
     prop.fromString(config.toString());
 
+    highRate = prop.check("high_rate", Value(false)).asBool();
+    jitterReportPeriod = prop.check("jitter_report_period", Value(5.0)).asFloat64();
+    if (jitterReportPeriod < 0) {
+        yCError(CONTROLBOARD) << "'jitter_report_period' parameter is not valid, read value is" << jitterReportPeriod;
+        return false;
+    }
+
+    std::string policy = prop.check("stamp_policy", Value("average")).asString();
+    if (policy == "average") {
+        stampPolicy = StampPolicy::average;
+    } else if (policy == "oldest") {
+        stampPolicy = StampPolicy::oldest;
+    } else if (policy == "newest") {
+        stampPolicy = StampPolicy::newest;
+    } else {
+        yCError(CONTROLBOARD) << "'stamp_policy' parameter is not valid, read value is" << policy << ", allowed values are average, oldest and newest";
+        return false;
+    }
+
+    splitByGroup = prop.check("split_by_group", Value(false)).asBool();
+    if (splitByGroup && highRate) {
+        yCError(CONTROLBOARD) << "'split_by_group' is not available in high rate mode";
+        return false;
+    }
+    groupStampTolerance = prop.check("group_stamp_tolerance", Value(0.0)).asFloat64();
+    if (groupStampTolerance < 0) {
+        yCError(CONTROLBOARD) << "'group_stamp_tolerance' parameter is not valid, read value is" << groupStampTolerance;
+        return false;
+    }
+
+    if (prop.check("deadband")) {
+        deadbandEnabled = true;
+        deadbandParam.clear();
+        const Value& v = prop.find("deadband");
+        if (v.isList()) {
+            Bottle* list = v.asList();
+            for (size_t i = 0; i < list->size(); i++) {
+                deadbandParam.push_back(list->get(i).asFloat64());
+            }
+        } else {
+            deadbandParam.push_back(v.asFloat64());
+        }
+        if (deadbandParam.empty() || *std::min_element(deadbandParam.begin(), deadbandParam.end()) < 0) {
+            yCError(CONTROLBOARD) << "'deadband' parameter must contain non negative values";
+            return false;
+        }
+    }
+    keepalivePeriod = prop.check("keepalive_period", Value(1.0)).asFloat64();
+    if (keepalivePeriod < 0) {
+        yCError(CONTROLBOARD) << "'keepalive_period' parameter is not valid, read value is" << keepalivePeriod;
+        return false;
+    }
+
+    if (config.check("skew_topic_name")) {
+        skewTopicName = config.find("skew_topic_name").asString();
+        if (skewTopicName[0] != '/') {
+            yCError(CONTROLBOARD) << "skew_topic_name must begin with an initial /";
+            return false;
+        }
+    }
+
     // Check parameter, so if both are present we use the correct one
     if (prop.check("period")) {
         if (!prop.find("period").isFloat64()) {
@@ -68,6 +143,9 @@ bool ControlBoard_nws_ros::open(Searchable& config)
             yCError(CONTROLBOARD) << "'period' parameter is not valid, read value is" << period;
             return false;
         }
+    } else if (highRate) {
+        yCDebug(CONTROLBOARD) << "'period' parameter missing, using default high rate thread period = 0.001s";
+        period = default_high_rate_period;
     } else {
         yCDebug(CONTROLBOARD) << "'period' parameter missing, using default thread period = 0.02s";
         period = default_period;
@@ -96,87 +174,162 @@ bool ControlBoard_nws_ros::open(Searchable& config)
     }
     yCInfo(CONTROLBOARD) << "topic_name is " << topicName;
     // call ROS node/topic initialization
-    node = new yarp::os::Node(nodeName);
-    if (!publisherPort.topic(topicName)) {
+    sharedNode = config.check("shared_node", Value(false)).asBool();
+    node = sharedNode ? RosNodeRegistry::acquire(nodeName) : new yarp::os::Node(nodeName);
+    if (!publisherPort.topic(sharedNode ? RosNodeRegistry::topicOnNode(topicName, nodeName) : topicName)) {
         yCError(CONTROLBOARD) << " opening " << topicName << " Topic, check your configuration";
         return false;
     }
+    if (!skewTopicName.empty() && !skewPublisher.topic(sharedNode ? RosNodeRegistry::topicOnNode(skewTopicName, nodeName) : skewTopicName)) {
+        yCError(CONTROLBOARD) << " opening " << skewTopicName << " Topic, check your configuration";
+        return false;
+    }
 
     return true;
 }
 
-bool ControlBoard_nws_ros::setDevice(yarp::dev::DeviceDriver* driver)
+bool ControlBoard_nws_ros::addDevice(yarp::dev::DeviceDriver* driver, const std::string& key)
 {
     yCAssert(CONTROLBOARD, driver);
 
-    // Save the pointer and subDeviceOwned
-    m_attached_device_ptr = driver;
+    SubDevice sub;
+    sub.device = driver;
+    sub.key = key;
 
-    m_attached_device_ptr->view(iPositionControl);
-    if (!iPositionControl) {
-        yCError(CONTROLBOARD, "<%s - %s>: IPositionControl interface was not found in attached device. Quitting", nodeName.c_str(), topicName.c_str());
+    sub.device->view(sub.iPositionControl);
+    if (!sub.iPositionControl) {
+        yCError(CONTROLBOARD, "<%s - %s>: IPositionControl interface was not found in attached device %s. Quitting", nodeName.c_str(), topicName.c_str(), key.c_str());
         return false;
     }
 
-    m_attached_device_ptr->view(iEncodersTimed);
-    if (!iEncodersTimed) {
-        yCError(CONTROLBOARD, "<%s - %s>: IEncodersTimed interface was not found in attached device. Quitting", nodeName.c_str(), topicName.c_str());
+    sub.device->view(sub.iEncodersTimed);
+    if (!sub.iEncodersTimed) {
+        yCError(CONTROLBOARD, "<%s - %s>: IEncodersTimed interface was not found in attached device %s. Quitting", nodeName.c_str(), topicName.c_str(), key.c_str());
         return false;
     }
 
-    m_attached_device_ptr->view(iTorqueControl);
-    if (!iTorqueControl) {
-        yCWarning(CONTROLBOARD, "<%s - %s>: ITorqueControl interface was not found in attached device.", nodeName.c_str(), topicName.c_str());
+    sub.device->view(sub.iTorqueControl);
+    if (!sub.iTorqueControl) {
+        yCWarning(CONTROLBOARD, "<%s - %s>: ITorqueControl interface was not found in attached device %s.", nodeName.c_str(), topicName.c_str(), key.c_str());
     }
 
-    m_attached_device_ptr->view(iAxisInfo);
-    if (!iAxisInfo) {
-        yCError(CONTROLBOARD, "<%s - %s>: IAxisInfo interface was not found in attached device. Quitting", nodeName.c_str(), topicName.c_str());
+    sub.device->view(sub.iAxisInfo);
+    if (!sub.iAxisInfo) {
+        yCError(CONTROLBOARD, "<%s - %s>: IAxisInfo interface was not found in attached device %s. Quitting", nodeName.c_str(), topicName.c_str(), key.c_str());
         return false;
     }
 
     // Get the number of controlled joints
     int tmp_axes;
-    if (!iPositionControl->getAxes(&tmp_axes)) {
-        yCError(CONTROLBOARD, "<%s - %s>: Failed to get axes number for attached device ", nodeName.c_str(), topicName.c_str());
+    if (!sub.iPositionControl->getAxes(&tmp_axes)) {
+        yCError(CONTROLBOARD, "<%s - %s>: Failed to get axes number for attached device %s", nodeName.c_str(), topicName.c_str(), key.c_str());
         return false;
     }
     if (tmp_axes <= 0) {
-        yCError(CONTROLBOARD, "<%s - %s>: attached device has an invalid number of joints (%d)", nodeName.c_str(), topicName.c_str(), tmp_axes);
+        yCError(CONTROLBOARD, "<%s - %s>: attached device %s has an invalid number of joints (%d)", nodeName.c_str(), topicName.c_str(), key.c_str(), tmp_axes);
         return false;
     }
-    subdevice_joints = static_cast<size_t>(tmp_axes);
+    sub.joints = static_cast<size_t>(tmp_axes);
+    sub.offset = subdevice_joints;
+    subdevice_joints += sub.joints;
+    subdevices.push_back(sub);
+
+    return true;
+}
+
+
+bool ControlBoard_nws_ros::setupJoints()
+{
+    // The messages of the publisher pool must be named and sized again,
+    // even when the number of joints did not change
+    jointsGeneration++;
+
     times.resize(subdevice_joints);
     ros_struct.name.resize(subdevice_joints);
     ros_struct.position.resize(subdevice_joints);
     ros_struct.velocity.resize(subdevice_joints);
-    ros_struct.effort.resize(subdevice_joints);
+    ros_struct.effort.assign(subdevice_joints, 0.0);
 
     if (!updateAxisName()) {
         return false;
     }
 
+    if (!updateJointScales()) {
+        return false;
+    }
+
+    if (!setupDeadband()) {
+        return false;
+    }
+
+    return true;
+}
+
+
+bool ControlBoard_nws_ros::setupDeadband()
+{
+    publishedCount = 0;
+    suppressedCount = 0;
+    firstPublish = true;
+
+    if (!deadbandEnabled) {
+        return true;
+    }
+
+    if (deadbandParam.size() == 1) {
+        deadband.assign(subdevice_joints, deadbandParam[0]);
+    } else if (deadbandParam.size() == subdevice_joints) {
+        deadband = deadbandParam;
+    } else {
+        yCError(CONTROLBOARD, "<%s - %s>: 'deadband' has %zu values, expected 1 or %zu", nodeName.c_str(), topicName.c_str(), deadbandParam.size(), subdevice_joints);
+        return false;
+    }
+    lastPublishedPositions.assign(subdevice_joints, 0.0);
+
+    return true;
+}
+
+
+bool ControlBoard_nws_ros::checkDeadband(const yarp::rosmsg::sensor_msgs::JointState& msg)
+{
+    if (!deadbandEnabled) {
+        publishedCount++;
+        return true;
+    }
+
+    double now = yarp::os::Time::now();
+    bool publish = firstPublish || (keepalivePeriod > 0.0 && now - lastPublishTime >= keepalivePeriod);
+    for (size_t i = 0; i < subdevice_joints && !publish; i++) {
+        publish = std::abs(msg.position[i] - lastPublishedPositions[i]) > deadband[i];
+    }
+
+    if (!publish) {
+        suppressedCount++;
+        return false;
+    }
+
+    std::copy(msg.position.begin(), msg.position.end(), lastPublishedPositions.begin());
+    lastPublishTime = now;
+    firstPublish = false;
+    publishedCount++;
     return true;
 }
 
 
 void ControlBoard_nws_ros::closeDevice()
 {
-    m_attached_device_ptr = nullptr;
+    subdevices.clear();
     subdevice_joints = 0;
 
     times.clear();
-
-    // Clear all interfaces
-    iPositionControl = nullptr;
-    iEncodersTimed = nullptr;
-    iTorqueControl = nullptr;
-    iAxisInfo = nullptr;
+    jointScales.clear();
 }
 
-bool ControlBoard_nws_ros::attach(yarp::dev::PolyDriver* poly)
+
+bool ControlBoard_nws_ros::startPublishing()
 {
-    if (!setDevice(poly)) {
+    if (!setupJoints()) {
+        closeDevice();
         return false;
     }
 
@@ -189,6 +342,49 @@ bool ControlBoard_nws_ros::attach(yarp::dev::PolyDriver* poly)
     return true;
 }
 
+
+bool ControlBoard_nws_ros::attach(yarp::dev::PolyDriver* poly)
+{
+    // The thread must not read the devices while they are replaced
+    if (isRunning()) {
+        stop();
+    }
+    closeDevice();
+
+    if (!addDevice(poly, "")) {
+        closeDevice();
+        return false;
+    }
+
+    return startPublishing();
+}
+
+
+bool ControlBoard_nws_ros::attachAll(const yarp::dev::PolyDriverList& polylist)
+{
+    // The thread must not read the devices while they are replaced
+    if (isRunning()) {
+        stop();
+    }
+    closeDevice();
+
+    if (polylist.size() <= 0) {
+        yCError(CONTROLBOARD) << "No device to attach";
+        return false;
+    }
+
+    // The joints are published in the order of the list
+    for (int i = 0; i < polylist.size(); i++) {
+        if (!addDevice(polylist[i]->poly, polylist[i]->key)) {
+            closeDevice();
+            return false;
+        }
+    }
+
+    return startPublishing();
+}
+
+
 bool ControlBoard_nws_ros::detach()
 {
     // Ensure that the device is not running
@@ -196,72 +392,295 @@ bool ControlBoard_nws_ros::detach()
         stop();
     }
 
+    if (deadbandEnabled && !subdevices.empty()) {
+        yCInfo(CONTROLBOARD, "<%s>: %zu messages published, %zu suppressed by the deadband", topicName.c_str(), getPublishedCount(), getSuppressedCount());
+    }
+
     closeDevice();
 
     return true;
 }
 
 
+bool ControlBoard_nws_ros::detachAll()
+{
+    return detach();
+}
+
+
 bool ControlBoard_nws_ros::updateAxisName()
 {
     // IMPORTANT!! This function has to be called BEFORE the thread starts,
     // the name has to be correct right from the first message!!
 
-    yCAssert(CONTROLBOARD, iAxisInfo);
-
     std::vector<std::string> tmpVect;
-    for (size_t i = 0; i < subdevice_joints; i++) {
-        std::string tmp;
-        bool ret = iAxisInfo->getAxisName(i, tmp);
-        if (!ret) {
-            yCError(CONTROLBOARD, "Joint name for axis %zu not found!", i);
-            return false;
+    for (const auto& sub : subdevices) {
+        yCAssert(CONTROLBOARD, sub.iAxisInfo);
+        for (size_t i = 0; i < sub.joints; i++) {
+            std::string tmp;
+            bool ret = sub.iAxisInfo->getAxisName(i, tmp);
+            if (!ret) {
+                yCError(CONTROLBOARD, "Joint name for axis %zu of device %s not found!", i, sub.key.c_str());
+                return false;
+            }
+            tmpVect.emplace_back(tmp);
         }
-        tmpVect.emplace_back(tmp);
     }
 
     yCAssert(CONTROLBOARD, tmpVect.size() == subdevice_joints);
 
     jointNames = tmpVect;
+    ros_struct.name = jointNames;
 
     return true;
 }
 
 
-void ControlBoard_nws_ros::run()
+bool ControlBoard_nws_ros::updateJointScales()
 {
-    yCAssert(CONTROLBOARD, iEncodersTimed);
-    yCAssert(CONTROLBOARD, iAxisInfo);
+    // As for the names, the joint types are not expected to change while
+    // the device is attached, so the conversion factors are computed once.
+
+    jointScales.resize(subdevice_joints);
+    for (const auto& sub : subdevices) {
+        yCAssert(CONTROLBOARD, sub.iAxisInfo);
+        for (size_t i = 0; i < sub.joints; i++) {
+            JointTypeEnum jType = VOCAB_JOINTTYPE_REVOLUTE;
+            if (!sub.iAxisInfo->getJointType(i, jType)) {
+                // Not all the devices provide the joint types, such joints are published as revolute
+                yCWarning(CONTROLBOARD, "Joint type for axis %zu of device %s not found, assuming a revolute joint", i, sub.key.c_str());
+                jType = VOCAB_JOINTTYPE_REVOLUTE;
+            }
+            jointScales[sub.offset + i] = (jType == VOCAB_JOINTTYPE_REVOLUTE) ? convertDegreesToRadians(1.0) : 1.0;
+        }
+    }
+
+    return true;
+}
+
 
-    bool positionsOk = iEncodersTimed->getEncodersTimed(ros_struct.position.data(), times.data());
-    YARP_UNUSED(positionsOk);
+bool ControlBoard_nws_ros::threadInit()
+{
+    std::lock_guard<std::mutex> lock(jitterMutex);
+    jitter = JitterStatistics();
+    jitterM2 = 0.0;
+    lastRunTime = 0.0;
+    lastReportTime = SystemClock::nowSystem();
+    return true;
+}
+
+
+double ControlBoard_nws_ros::computeStamp(const double* stamps, size_t size) const
+{
+    switch (stampPolicy) {
+    case StampPolicy::oldest:
+        return *std::min_element(stamps, stamps + size);
+    case StampPolicy::newest:
+        return *std::max_element(stamps, stamps + size);
+    case StampPolicy::average:
+    default:
+        return std::accumulate(stamps, stamps + size, 0.0) / size;
+    }
+}
 
-    bool speedsOk = iEncodersTimed->getEncoderSpeeds(ros_struct.velocity.data());
-    YARP_UNUSED(speedsOk);
 
-    if (iTorqueControl) {
-        bool torqueOk = iTorqueControl->getTorques(ros_struct.effort.data());
-        YARP_UNUSED(torqueOk);
+void ControlBoard_nws_ros::acquireJointState(yarp::rosmsg::sensor_msgs::JointState& msg)
+{
+    // The three quantities are read back to back, directly into the message,
+    // each attached device filling its own slice
+    for (const auto& sub : subdevices) {
+        bool positionsOk = sub.iEncodersTimed->getEncodersTimed(msg.position.data() + sub.offset, times.data() + sub.offset);
+        YARP_UNUSED(positionsOk);
+
+        bool speedsOk = sub.iEncodersTimed->getEncoderSpeeds(msg.velocity.data() + sub.offset);
+        YARP_UNUSED(speedsOk);
+
+        if (sub.iTorqueControl) {
+            bool torqueOk = sub.iTorqueControl->getTorques(msg.effort.data() + sub.offset);
+            YARP_UNUSED(torqueOk);
+        } else {
+            std::fill_n(msg.effort.data() + sub.offset, sub.joints, 0.0);
+        }
     }
 
-    // Update the port envelope time by averaging all timestamps
-    time.update(std::accumulate(times.begin(), times.end(), 0.0) / subdevice_joints);
-    yarp::os::Stamp averageTime = time;
+    // Update the port envelope time according to the stamp policy
+    time.update(computeStamp(times.data(), subdevice_joints));
+    auto minmax = std::minmax_element(times.begin(), times.end());
+    stampSkew = *minmax.second - *minmax.first;
 
-    // Data from HW have been gathered few lines before
-    JointTypeEnum jType;
+    // Revolute joints are converted from degrees to radians, the others are left untouched
+    const double* scale = jointScales.data();
+    double* position = msg.position.data();
+    double* velocity = msg.velocity.data();
     for (size_t i = 0; i < subdevice_joints; i++) {
-        iAxisInfo->getJointType(i, jType);
-        if (jType == VOCAB_JOINTTYPE_REVOLUTE) {
-            ros_struct.position[i] = convertDegreesToRadians(ros_struct.position[i]);
-            ros_struct.velocity[i] = convertDegreesToRadians(ros_struct.velocity[i]);
+        position[i] *= scale[i];
+        velocity[i] *= scale[i];
+    }
+
+    msg.header.seq = counter++;
+    msg.header.stamp = time.getTime();
+}
+
+
+void ControlBoard_nws_ros::updateJitter(double now)
+{
+    std::lock_guard<std::mutex> lock(jitterMutex);
+
+    if (lastRunTime > 0.0) {
+        // Welford's online algorithm
+        double dt = now - lastRunTime;
+        jitter.samples++;
+        double delta = dt - jitter.mean;
+        jitter.mean += delta / jitter.samples;
+        jitterM2 += delta * (dt - jitter.mean);
+        jitter.stdev = (jitter.samples > 1) ? std::sqrt(jitterM2 / (jitter.samples - 1)) : 0.0;
+        jitter.min = (jitter.samples == 1) ? dt : std::min(jitter.min, dt);
+        jitter.max = (jitter.samples == 1) ? dt : std::max(jitter.max, dt);
+    }
+    lastRunTime = now;
+
+    if (jitterReportPeriod > 0.0 && now - lastReportTime >= jitterReportPeriod) {
+        yCInfo(CONTROLBOARD,
+               "<%s>: period %.3f ms (std %.3f ms, min %.3f ms, max %.3f ms) over %zu samples",
+               topicName.c_str(),
+               jitter.mean * 1000.0,
+               jitter.stdev * 1000.0,
+               jitter.min * 1000.0,
+               jitter.max * 1000.0,
+               jitter.samples);
+        jitter = JitterStatistics();
+        jitterM2 = 0.0;
+        lastReportTime = now;
+    }
+}
+
+
+ControlBoard_nws_ros::JitterStatistics ControlBoard_nws_ros::getJitterStatistics() const
+{
+    std::lock_guard<std::mutex> lock(jitterMutex);
+    return jitter;
+}
+
+
+void ControlBoard_nws_ros::publishSkew()
+{
+    yarp::rosmsg::std_msgs::Float64& skew = skewPublisher.prepare();
+    skew.data = stampSkew;
+    skewPublisher.write();
+}
+
+
+void ControlBoard_nws_ros::publishGroups()
+{
+    // Find the groups of consecutive joints sharing the same timestamp
+    size_t groups = 0;
+    bool changed = false;
+    size_t begin = 0;
+    for (size_t i = 1; i <= subdevice_joints; i++) {
+        if (i == subdevice_joints || std::abs(times[i] - times[begin]) > groupStampTolerance) {
+            if (groups >= groupRanges.size()) {
+                groupRanges.emplace_back(begin, i);
+                changed = true;
+            } else if (groupRanges[groups].first != begin || groupRanges[groups].second != i) {
+                groupRanges[groups] = {begin, i};
+                changed = true;
+            }
+            groups++;
+            begin = i;
         }
     }
+    if (groups != groupRanges.size()) {
+        groupRanges.resize(groups);
+        changed = true;
+    }
+
+    // The names are copied only when the groups change
+    if (changed) {
+        groupStructs.resize(groups);
+        for (size_t g = 0; g < groups; g++) {
+            auto first = jointNames.begin() + groupRanges[g].first;
+            auto last = jointNames.begin() + groupRanges[g].second;
+            groupStructs[g].name.assign(first, last);
+            size_t size = groupRanges[g].second - groupRanges[g].first;
+            groupStructs[g].position.resize(size);
+            groupStructs[g].velocity.resize(size);
+            groupStructs[g].effort.resize(size);
+        }
+    }
+
+    for (size_t g = 0; g < groups; g++) {
+        size_t first = groupRanges[g].first;
+        size_t last = groupRanges[g].second;
+        yarp::rosmsg::sensor_msgs::JointState& msg = groupStructs[g];
+        std::copy(ros_struct.position.begin() + first, ros_struct.position.begin() + last, msg.position.begin());
+        std::copy(ros_struct.velocity.begin() + first, ros_struct.velocity.begin() + last, msg.velocity.begin());
+        std::copy(ros_struct.effort.begin() + first, ros_struct.effort.begin() + last, msg.effort.begin());
+        msg.header.seq = ros_struct.header.seq;
+        msg.header.stamp = computeStamp(times.data() + first, last - first);
+        publisherPort.write(msg);
+    }
+}
+
+
+void ControlBoard_nws_ros::runHighRate()
+{
+    updateJitter(SystemClock::nowSystem());
+
+    // The messages of the publisher pool are sized and named only the first
+    // time they are used after an attach, afterwards no allocation is performed
+    yarp::rosmsg::sensor_msgs::JointState& msg = publisherPort.prepare();
+    auto pooled = std::find_if(pooledGenerations.begin(), pooledGenerations.end(), [&msg](const auto& entry) { return entry.first == &msg; });
+    if (pooled == pooledGenerations.end()) {
+        pooledGenerations.emplace_back(&msg, 0);
+        pooled = pooledGenerations.end() - 1;
+    }
+    if (pooled->second != jointsGeneration) {
+        msg.name = jointNames;
+        msg.position.resize(subdevice_joints);
+        msg.velocity.resize(subdevice_joints);
+        msg.effort.assign(subdevice_joints, 0.0);
+        pooled->second = jointsGeneration;
+    }
+
+    acquireJointState(msg);
+
+    if (!checkDeadband(msg)) {
+        publisherPort.unprepare();
+        return;
+    }
+
+    // Do not wait for the previous message to be delivered
+    publisherPort.write();
+
+    if (!skewTopicName.empty()) {
+        publishSkew();
+    }
+}
 
-    ros_struct.name = jointNames;
 
-    ros_struct.header.seq = counter++;
-    ros_struct.header.stamp = averageTime.getTime();
+void ControlBoard_nws_ros::run()
+{
+    yCAssert(CONTROLBOARD, !subdevices.empty());
+
+    if (highRate) {
+        runHighRate();
+        return;
+    }
+
+    acquireJointState(ros_struct);
 
-    publisherPort.write(ros_struct);
+    if (!checkDeadband(ros_struct)) {
+        return;
+    }
+
+    if (splitByGroup) {
+        publishGroups();
+    } else {
+        // ros_struct.name has been filled by updateAxisName()
+        publisherPort.write(ros_struct);
+    }
+
+    if (!skewTopicName.empty()) {
+        publishSkew();
+    }
 }
@@ -8,6 +8,7 @@
 
 #include <yarp/dev/DeviceDriver.h>
 #include <yarp/dev/WrapperSingle.h>
+#include <yarp/dev/IMultipleWrapper.h>
 #include <yarp/os/PeriodicThread.h>
 
 #include <yarp/dev/IPositionControl.h>
@@ -18,12 +19,18 @@
 #include <yarp/os/Stamp.h>
 #include <yarp/sig/Vector.h>
 
+#include <atomic>
+#include <mutex>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <yarp/os/Node.h>
 #include <yarp/os/Publisher.h>
 #include <yarp/rosmsg/sensor_msgs/JointState.h>
+#include <yarp/rosmsg/std_msgs/Float64.h>
+
+#include <RosNodeRegistry.h>
 
 
 /**
@@ -38,49 +45,149 @@
  * |:---------------:|:--------------:|:-------:|:--------------:|:-------------:|:--------------------------: |:-----------------------------------------------------------------:|:-----:|
  * | node_name       |      -         | string  | -              |   -           | Yes                         | set the name for ROS node                                         | must start with a leading '/' |
  * | topic_name      |      -         | string  | -              |   -           | Yes                         | set the name for ROS topic                                        | must start with a leading '/', recommended value is /joint_states |
- * | period          |      -         | double  | s              |   0.02        | No                          | refresh period of the broadcasted values in s                     | optional, default 20ms |
+ * | shared_node     |      -         | bool    | -              |   false       | No                          | share the ROS node with the other devices of the process declaring the same node_name | the devices of other plugin libraries are included only on some platforms, see RosNodeRegistry |
+ * | period          |      -         | double  | s              |   0.02        | No                          | refresh period of the broadcasted values in s                     | optional, default 20ms (1ms if high_rate is enabled) |
+ * | high_rate       |      -         | bool    | -              |   false       | No                          | enable the high rate publishing mode                              | see below |
+ * | jitter_report_period | -         | double  | s              |   5.0         | No                          | period of the jitter statistics printed in high rate mode         | 0 disables the report |
+ * | stamp_policy    |      -         | string  | -              |   average     | No                          | how the message stamp is computed from the per-joint timestamps   | average, oldest or newest |
+ * | skew_topic_name |      -         | string  | -              |   -           | No                          | if set, the spread (newest - oldest) of the per-joint timestamps is published on this topic as std_msgs/Float64, in s | must start with a leading '/' |
+ * | split_by_group  |      -         | bool    | -              |   false       | No                          | publish one JointState per group of consecutive joints sharing the same timestamp | not available in high rate mode |
+ * | group_stamp_tolerance | -        | double  | s              |   0.0         | No                          | max difference between the timestamps of the joints of a group    | - |
+ * | deadband        |      -         | double or list | rad or m |   -           | No                          | if set, a message is published only when a joint moved more than its threshold since the last published message | a single value for all the joints or one value per joint |
+ * | keepalive_period |     -         | double  | s              |   1.0         | No                          | in deadband mode, max time between two published messages        | 0 means no keepalive |
+ *
+ * The device can be attached to a single control board (attach) or to several ones (attachAll), for instance
+ * one per robot part: in the latter case the joints of all the boards are published in a single JointState, in
+ * the order of the attached list, from a single thread and with a single stamp policy.
  *
  * ROS message type used is sensor_msgs/JointState.msg (http://docs.ros.org/api/sensor_msgs/html/msg/JointState.html)
+ *
+ * In high rate mode (meant for rates up to 1kHz) positions, velocities and torques are read back to back
+ * directly into a message taken from the publisher pool, which is already sized and already holds the
+ * joint names, and the message is sent without waiting for the previous one to be delivered.
+ * The measured period of the thread is collected (mean, standard deviation, min and max) and periodically
+ * printed.
+ *
+ * When the attached device aggregates several boards (e.g. a remapper), the joints of each board usually share
+ * the same timestamp. With split_by_group enabled, every group of consecutive joints whose timestamps differ
+ * less than group_stamp_tolerance is published in its own (partial) JointState on topic_name, stamped with the
+ * time of the group, so that consumers can interpolate each group correctly.
+ *
+ * In deadband mode the positions (in ROS units) are compared with the ones of the last published message, and the
+ * message is suppressed if no joint moved beyond its threshold and the keepalive period has not expired.
+ * The number of published and suppressed messages is printed when the device is detached.
  */
 
 class ControlBoard_nws_ros :
         public yarp::dev::DeviceDriver,
         public yarp::os::PeriodicThread,
-        public yarp::dev::WrapperSingle
+        public yarp::dev::WrapperSingle,
+        public yarp::dev::IMultipleWrapper
 {
 private:
     yarp::rosmsg::sensor_msgs::JointState ros_struct;
 
     yarp::sig::Vector times; // time for each joint
+    std::vector<double> jointScales; // per joint yarp to ROS unit conversion, computed at attach
 
     std::vector<std::string> jointNames; // name of the joints
     std::string nodeName;                // name of the rosNode
     std::string topicName;               // name of the rosTopic
 
-    yarp::os::Node* node; // ROS node
+    yarp::os::Node* node {nullptr}; // ROS node
+    bool sharedNode {false};        // node obtained from yarp::dev::RosNodeRegistry
     std::uint32_t counter {0}; // incremental counter in the ROS message
 
     yarp::os::PortWriterBuffer<yarp::rosmsg::sensor_msgs::JointState> outputState_buffer; // Buffer associated to the ROS topic
     yarp::os::Publisher<yarp::rosmsg::sensor_msgs::JointState> publisherPort;             // Dedicated ROS topic publisher
 
     static constexpr double default_period = 0.02; // s
+    static constexpr double default_high_rate_period = 0.001; // s
     double period {default_period};
 
     yarp::os::Stamp time; // envelope to attach to the state port
 
-    yarp::dev::DeviceDriver* m_attached_device_ptr{nullptr};
-    size_t subdevice_joints {0};
+    enum class StampPolicy
+    {
+        average,
+        oldest,
+        newest
+    };
+    StampPolicy stampPolicy {StampPolicy::average};
+    double stampSkew {0.0}; // s, newest - oldest per-joint timestamp of the last acquisition
+
+    std::string skewTopicName;
+    yarp::os::Publisher<yarp::rosmsg::std_msgs::Float64> skewPublisher;
+
+    bool splitByGroup {false};
+    double groupStampTolerance {0.0}; // s
+    std::vector<std::pair<size_t, size_t>> groupRanges; // [begin, end) of each group of the last cycle
+    std::vector<yarp::rosmsg::sensor_msgs::JointState> groupStructs;
+
+    bool deadbandEnabled {false};
+    std::vector<double> deadbandParam;        // as read from the configuration
+    std::vector<double> deadband;             // per joint, computed at attach
+    double keepalivePeriod {1.0};             // s
+    std::vector<double> lastPublishedPositions;
+    double lastPublishTime {0.0};
+    bool firstPublish {true};
+    std::atomic<size_t> publishedCount {0};
+    std::atomic<size_t> suppressedCount {0};
+
+    bool highRate {false};
+    double jitterReportPeriod {5.0}; // s
 
-    yarp::dev::IPositionControl* iPositionControl{nullptr};
-    yarp::dev::IEncodersTimed* iEncodersTimed{nullptr};
-    yarp::dev::ITorqueControl* iTorqueControl{nullptr};
-    yarp::dev::IAxisInfo* iAxisInfo{nullptr};
+public:
+    struct JitterStatistics
+    {
+        size_t samples {0};
+        double mean {0.0};  // s
+        double stdev {0.0}; // s
+        double min {0.0};   // s
+        double max {0.0};   // s
+    };
 
-    bool setDevice(yarp::dev::DeviceDriver* device);
+private:
+    mutable std::mutex jitterMutex;
+    JitterStatistics jitter;
+    double jitterM2 {0.0};
+    double lastRunTime {0.0};
+    double lastReportTime {0.0};
+
+    struct SubDevice
+    {
+        yarp::dev::DeviceDriver* device {nullptr};
+        std::string key;
+        yarp::dev::IPositionControl* iPositionControl {nullptr};
+        yarp::dev::IEncodersTimed* iEncodersTimed {nullptr};
+        yarp::dev::ITorqueControl* iTorqueControl {nullptr};
+        yarp::dev::IAxisInfo* iAxisInfo {nullptr};
+        size_t joints {0};
+        size_t offset {0}; // index of the first joint of the device in the message
+    };
+    std::vector<SubDevice> subdevices;
+    size_t subdevice_joints {0}; // total number of joints of the attached devices
+    size_t jointsGeneration {0}; // incremented at every attach, when the joints may change
+
+    // Generation of the joints last written into each message of the publisher pool
+    std::vector<std::pair<const yarp::rosmsg::sensor_msgs::JointState*, size_t>> pooledGenerations;
+
+    bool addDevice(yarp::dev::DeviceDriver* device, const std::string& key);
+    bool setupJoints();
+    bool startPublishing();
 
     void closeDevice();
     void closePorts();
     bool updateAxisName();
+    bool updateJointScales();
+    double computeStamp(const double* stamps, size_t size) const;
+    void acquireJointState(yarp::rosmsg::sensor_msgs::JointState& msg);
+    bool setupDeadband();
+    bool checkDeadband(const yarp::rosmsg::sensor_msgs::JointState& msg);
+    void publishGroups();
+    void publishSkew();
+    void updateJitter(double now);
+    void runHighRate();
 
 public:
     ControlBoard_nws_ros();
@@ -98,8 +205,25 @@ public:
     bool attach(yarp::dev::PolyDriver* poly) override;
     bool detach() override;
 
+    // yarp::dev::IMultipleWrapper
+    bool attachAll(const yarp::dev::PolyDriverList& p) override;
+    bool detachAll() override;
+
     // yarp::os::PeriodicThread
+    bool threadInit() override;
     void run() override;
+
+    /**
+     * Returns the statistics of the period of the thread measured in high rate mode,
+     * since the start or since the last report.
+     */
+    JitterStatistics getJitterStatistics() const;
+
+    /**
+     * Number of messages published and suppressed by the deadband since the last attach.
+     */
+    size_t getPublishedCount() const { return publishedCount; }
+    size_t getSuppressedCount() const { return suppressedCount; }
 };
 
 #endif // YARP_DEV_CONTROLBOARD_NWS_ROS_H
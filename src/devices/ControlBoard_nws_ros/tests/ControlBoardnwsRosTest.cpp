@@ -0,0 +1,277 @@
+/*
+ * SPDX-FileCopyrightText: 2006-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "ControlBoard_nws_ros.h"
+
+#include <yarp/os/LogStream.h>
+#include <yarp/os/Network.h>
+#include <yarp/os/Node.h>
+#include <yarp/os/Property.h>
+#include <yarp/os/Subscriber.h>
+#include <yarp/os/Time.h>
+#include <yarp/dev/PolyDriver.h>
+#include <yarp/dev/PolyDriverList.h>
+#include <yarp/rosmsg/impl/yarpRosHelper.h>
+#include <yarp/rosmsg/sensor_msgs/JointState.h>
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include <catch2/catch_amalgamated.hpp>
+#include <harness.h>
+
+using namespace yarp::dev;
+using namespace yarp::os;
+
+TEST_CASE("dev::controlBoard_nws_ros_Test", "[yarp::dev]")
+{
+    YARP_REQUIRE_PLUGIN("fakeMotionControl", "device");
+
+    Network::setLocalMode(true);
+
+    SECTION("High rate publishing with 64 joints")
+    {
+        PolyDriver fakeBoard;
+        {
+            Property p_cfg;
+            p_cfg.put("device", "fakeMotionControl");
+            p_cfg.fromString("(GENERAL (Joints 64))", false);
+            REQUIRE(fakeBoard.open(p_cfg));
+        }
+
+        ControlBoard_nws_ros nws;
+        {
+            Property p_cfg;
+            p_cfg.put("node_name", "/controlBoard_nws_ros_test");
+            p_cfg.put("topic_name", "/joint_states");
+            p_cfg.put("high_rate", Value(true));
+            p_cfg.put("jitter_report_period", 0.0);
+            REQUIRE(nws.open(p_cfg));
+        }
+        REQUIRE(nws.attach(&fakeBoard));
+
+        // The achieved period depends on the load of the machine, only the consistency of
+        // the statistics is checked, the figures are printed for reference
+        yarp::os::Time::delay(1.0);
+        nws.stop();
+        ControlBoard_nws_ros::JitterStatistics stats = nws.getJitterStatistics();
+        yInfo() << "controlBoard_nws_ros high rate period" << stats.mean << "s, std" << stats.stdev << "s, max" << stats.max << "s," << stats.samples << "samples";
+        CHECK(stats.samples > 0);
+        CHECK(stats.min <= stats.mean);
+        CHECK(stats.mean <= stats.max);
+        CHECK(stats.stdev >= 0.0);
+
+        // A single cycle must take far less than 1ms to sustain 1kHz on one core
+        BENCHMARK("controlBoard_nws_ros high rate cycle, 64 joints")
+        {
+            nws.run();
+        };
+
+        CHECK(nws.detach());
+        CHECK(nws.close());
+        CHECK(fakeBoard.close());
+    }
+
+    SECTION("Aggregation of several control boards")
+    {
+        PolyDriver fakeBoard1;
+        PolyDriver fakeBoard2;
+        {
+            Property p_cfg;
+            p_cfg.put("device", "fakeMotionControl");
+            p_cfg.fromString("(GENERAL (Joints 4))", false);
+            REQUIRE(fakeBoard1.open(p_cfg));
+        }
+        {
+            Property p_cfg;
+            p_cfg.put("device", "fakeMotionControl");
+            p_cfg.fromString("(GENERAL (Joints 6))", false);
+            REQUIRE(fakeBoard2.open(p_cfg));
+        }
+
+        ControlBoard_nws_ros nws;
+        {
+            Property p_cfg;
+            p_cfg.put("node_name", "/controlBoard_nws_ros_test");
+            p_cfg.put("topic_name", "/joint_states");
+            p_cfg.put("stamp_policy", "oldest");
+            REQUIRE(nws.open(p_cfg));
+        }
+
+        Node node("/controlBoard_nws_ros_test_reader");
+        Subscriber<yarp::rosmsg::sensor_msgs::JointState> reader;
+        REQUIRE(reader.topic("/joint_states"));
+
+        // Attaching again while publishing replaces the devices
+        REQUIRE(nws.attach(&fakeBoard1));
+        PolyDriverList boards;
+        boards.push(&fakeBoard1, "part1");
+        boards.push(&fakeBoard2, "part2");
+        REQUIRE(nws.attachAll(boards));
+
+        // Only the messages of the two boards are considered
+        yarp::rosmsg::sensor_msgs::JointState* msg = nullptr;
+        for (int i = 0; i < 200; i++) {
+            msg = reader.read(false);
+            if (msg != nullptr && msg->name.size() == 10) {
+                break;
+            }
+            msg = nullptr;
+            yarp::os::Time::delay(0.01);
+        }
+        REQUIRE(msg != nullptr);
+
+        // The joints of part1 come first, then those of part2
+        REQUIRE(msg->position.size() == 10);
+        size_t offset = 0;
+        for (PolyDriver* board : { &fakeBoard1, &fakeBoard2 }) {
+            IAxisInfo* iAxisInfo = nullptr;
+            IEncodersTimed* iEncoders = nullptr;
+            REQUIRE(board->view(iAxisInfo));
+            REQUIRE(board->view(iEncoders));
+            int axes = 0;
+            REQUIRE(iEncoders->getAxes(&axes));
+            for (int i = 0; i < axes; i++) {
+                std::string name;
+                double position = 0;
+                JointTypeEnum type;
+                REQUIRE(iAxisInfo->getAxisName(i, name));
+                REQUIRE(iEncoders->getEncoder(i, &position));
+                REQUIRE(iAxisInfo->getJointType(i, type));
+                if (type == VOCAB_JOINTTYPE_REVOLUTE) {
+                    position = convertDegreesToRadians(position);
+                }
+                CHECK(msg->name[offset + i] == name);
+                CHECK(std::abs(msg->position[offset + i] - position) < 1e-9);
+            }
+            offset += axes;
+        }
+        CHECK(offset == 10);
+
+        reader.close();
+        CHECK(nws.detachAll());
+        CHECK(nws.close());
+        CHECK(fakeBoard1.close());
+        CHECK(fakeBoard2.close());
+    }
+
+    SECTION("High rate messages follow the joints of the last attach")
+    {
+        PolyDriver fakeBoard;
+        PolyDriver fakeBoard1;
+        PolyDriver fakeBoard2;
+        {
+            Property p_cfg;
+            p_cfg.put("device", "fakeMotionControl");
+            p_cfg.fromString("(GENERAL (Joints 8))", false);
+            REQUIRE(fakeBoard.open(p_cfg));
+        }
+        for (PolyDriver* board : { &fakeBoard1, &fakeBoard2 }) {
+            Property p_cfg;
+            p_cfg.put("device", "fakeMotionControl");
+            p_cfg.fromString("(GENERAL (Joints 4))", false);
+            REQUIRE(board->open(p_cfg));
+        }
+
+        ControlBoard_nws_ros nws;
+        {
+            Property p_cfg;
+            p_cfg.put("node_name", "/controlBoard_nws_ros_test");
+            p_cfg.put("topic_name", "/joint_states");
+            p_cfg.put("high_rate", Value(true));
+            p_cfg.put("jitter_report_period", 0.0);
+            REQUIRE(nws.open(p_cfg));
+        }
+
+        Node node("/controlBoard_nws_ros_test_reader");
+        Subscriber<yarp::rosmsg::sensor_msgs::JointState> reader;
+        REQUIRE(reader.topic("/joint_states"));
+
+        // The pooled messages are filled with the 8 joints of the first board, then the same number
+        // of joints comes from two other boards: every message must carry their names
+        REQUIRE(nws.attach(&fakeBoard));
+        yarp::os::Time::delay(0.2);
+        PolyDriverList boards;
+        boards.push(&fakeBoard1, "part1");
+        boards.push(&fakeBoard2, "part2");
+        REQUIRE(nws.attachAll(boards));
+        yarp::os::Time::delay(0.2);
+        nws.stop();
+        while (reader.read(false) != nullptr) {
+        }
+
+        std::vector<std::string> names;
+        for (PolyDriver* board : { &fakeBoard1, &fakeBoard2 }) {
+            IAxisInfo* iAxisInfo = nullptr;
+            REQUIRE(board->view(iAxisInfo));
+            for (int i = 0; i < 4; i++) {
+                std::string name;
+                REQUIRE(iAxisInfo->getAxisName(i, name));
+                names.push_back(name);
+            }
+        }
+        for (size_t i = 0; i < 10; i++) {
+            nws.run();
+            yarp::rosmsg::sensor_msgs::JointState* msg = nullptr;
+            for (int j = 0; j < 100 && msg == nullptr; j++) {
+                msg = reader.read(false);
+                if (msg == nullptr) {
+                    yarp::os::Time::delay(0.01);
+                }
+            }
+            REQUIRE(msg != nullptr);
+            CHECK(msg->name == names);
+            CHECK(msg->effort.size() == names.size());
+        }
+
+        reader.close();
+        CHECK(nws.detachAll());
+        CHECK(nws.close());
+        CHECK(fakeBoard.close());
+        CHECK(fakeBoard1.close());
+        CHECK(fakeBoard2.close());
+    }
+
+    SECTION("Deadband suppresses the messages of an idle robot")
+    {
+        PolyDriver fakeBoard;
+        {
+            Property p_cfg;
+            p_cfg.put("device", "fakeMotionControl");
+            p_cfg.fromString("(GENERAL (Joints 8))", false);
+            REQUIRE(fakeBoard.open(p_cfg));
+        }
+
+        ControlBoard_nws_ros nws;
+        {
+            Property p_cfg;
+            p_cfg.put("node_name", "/controlBoard_nws_ros_test");
+            p_cfg.put("topic_name", "/joint_states");
+            p_cfg.put("deadband", 0.001);
+            p_cfg.put("keepalive_period", 0.0);
+            REQUIRE(nws.open(p_cfg));
+        }
+        REQUIRE(nws.attach(&fakeBoard));
+        yarp::os::Time::delay(0.1);
+        nws.stop();
+
+        // The first message is always published, then the joints do not move
+        size_t published = nws.getPublishedCount();
+        size_t suppressed = nws.getSuppressedCount();
+        CHECK(published == 1);
+        for (size_t i = 0; i < 10; i++) {
+            nws.run();
+        }
+        CHECK(nws.getPublishedCount() == published);
+        CHECK(nws.getSuppressedCount() == suppressed + 10);
+
+        CHECK(nws.detach());
+        CHECK(nws.close());
+        CHECK(fakeBoard.close());
+    }
+
+    Network::setLocalMode(false);
+}
@@ -46,8 +46,12 @@ bool FrameGrabber_nws_ros::close()
     publisherPort_cameraInfo.close();
 
     if (node != nullptr) {
-        node->interrupt();
-        delete node;
+        if (m_sharedNode) {
+            yarp::dev::RosNodeRegistry::release(node);
+        } else {
+            node->interrupt();
+            delete node;
+        }
         node = nullptr;
     }
 
@@ -85,7 +89,8 @@ bool FrameGrabber_nws_ros::open(yarp::os::Searchable& config)
         return false;
     }
 
-    node = new yarp::os::Node(nodeName);
+    m_sharedNode = config.check("shared_node", yarp::os::Value(false)).asBool();
+    node = m_sharedNode ? yarp::dev::RosNodeRegistry::acquire(nodeName) : new yarp::os::Node(nodeName);
 
     // Check "topic_name" option and open publisher
     if (!config.check("topic_name"))
@@ -100,7 +105,7 @@ bool FrameGrabber_nws_ros::open(yarp::os::Searchable& config)
     }
 
     // set "imageTopicName" and open publisher
-    if (!publisherPort_image.topic(topicName)) {
+    if (!publisherPort_image.topic(m_sharedNode ? yarp::dev::RosNodeRegistry::topicOnNode(topicName, nodeName) : topicName)) {
         yCError(FRAMEGRABBER_NWS_ROS) << "Unable to publish data on " << topicName << " topic, check your yarp-ROS network configuration";
         return false;
     }
@@ -109,7 +114,7 @@ bool FrameGrabber_nws_ros::open(yarp::os::Searchable& config)
 
 
     std::string cameraInfoTopicName = topicName.substr(0,topicName.rfind('/')) + "/camera_info";
-    if (!publisherPort_cameraInfo.topic(cameraInfoTopicName)) {
+    if (!publisherPort_cameraInfo.topic(m_sharedNode ? yarp::dev::RosNodeRegistry::topicOnNode(cameraInfoTopicName, nodeName) : cameraInfoTopicName)) {
         yCError(FRAMEGRABBER_NWS_ROS) << "Unable to publish data on" << cameraInfoTopicName << "topic, check your yarp-ROS network configuration";
         return false;
     }
@@ -23,6 +23,8 @@
 #include <yarp/rosmsg/sensor_msgs/CameraInfo.h>
 #include <yarp/rosmsg/sensor_msgs/Image.h>
 
+#include <RosNodeRegistry.h>
+
 /**
  * @ingroup dev_impl_nws_ros
  *
@@ -34,6 +36,7 @@
  * |:---------------:|:------:|:-------:|:-------------:|:--------: |:----------------------------------------:|:-----:|
  * | period          | float  | seconds |  0.03 s       | No        | the period of publication                |       |
  * | node_name       | String | -       | -             | Yes       | the name of the ros node                 | must begin with /      |
+ * | shared_node     | bool   | -       | false         | No        | share the ros node with the other devices of the process declaring the same node_name | the devices of other plugin libraries are included only on some platforms, see RosNodeRegistry |
  * | topic_name      | String | -       | -             | Yes       | the name of the ros topic                | must begin with /      |
  * | frame_id        | String | -       | -             | Yes       | the frame where the grabber is placed    |       |
  *
@@ -50,6 +53,7 @@ private:
     typedef yarp::os::Publisher<yarp::rosmsg::sensor_msgs::CameraInfo> CameraInfoTopicType;
 
     yarp::os::Node* node {nullptr};
+    bool m_sharedNode {false}; // node obtained from yarp::dev::RosNodeRegistry
     ImageTopicType publisherPort_image;
     CameraInfoTopicType publisherPort_cameraInfo;
 
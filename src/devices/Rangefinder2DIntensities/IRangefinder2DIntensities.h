@@ -0,0 +1,34 @@
+/*
+ * SPDX-FileCopyrightText: 2006-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef YARP_DEV_IRANGEFINDER2DINTENSITIES_H
+#define YARP_DEV_IRANGEFINDER2DINTENSITIES_H
+
+#include <yarp/sig/Vector.h>
+
+namespace yarp::dev {
+
+/**
+ * Optional extension of yarp::dev::IRangefinder2D, implemented by the devices
+ * of this repository which are able to provide the intensity of each beam.
+ */
+class IRangefinder2DIntensities
+{
+public:
+    virtual ~IRangefinder2DIntensities() = default;
+
+    /**
+     * Get the last scan together with the intensities of its beams.
+     * @param ranges the vector of the distances, as returned by IRangefinder2D::getRawData()
+     * @param intensities the intensities, one for each element of ranges
+     * @param timestamp the timestamp of the scan
+     * @return false if the scan is not available, or if it does not carry intensity information
+     */
+    virtual bool getRawDataWithIntensities(yarp::sig::Vector& ranges, yarp::sig::Vector& intensities, double* timestamp = nullptr) = 0;
+};
+
+} // namespace yarp::dev
+
+#endif // YARP_DEV_IRANGEFINDER2DINTENSITIES_H
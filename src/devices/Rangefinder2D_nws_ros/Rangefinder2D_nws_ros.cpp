@@ -11,7 +11,9 @@
 
 #include <yarp/dev/ControlBoardInterfaces.h>
 
+#include <algorithm>
 #include <cmath>
+#include <limits>
 #include <sstream>
 
 using namespace yarp::sig;
@@ -28,14 +30,17 @@ YARP_LOG_COMPONENT(RANGEFINDER2D_NWS_ROS, "yarp.devices.rangefinder2D_nws_ros")
 
 Rangefinder2D_nws_ros::Rangefinder2D_nws_ros() : PeriodicThread(DEFAULT_THREAD_PERIOD),
     node(nullptr),
+    sharedNode(false),
     msgCounter(0),
     sens_p(nullptr),
+    intensities_p(nullptr),
     _period(DEFAULT_THREAD_PERIOD),
     minAngle(0),
     maxAngle(0),
     minDistance(0),
     maxDistance(0),
-    resolution(0)
+    resolution(0),
+    omitMissingIntensities(false)
 {}
 
 Rangefinder2D_nws_ros::~Rangefinder2D_nws_ros()
@@ -78,6 +83,8 @@ bool Rangefinder2D_nws_ros::checkROSParams(yarp::os::Searchable &config)
         return false;
     }
     frame_id = config.find("frame_id").asString();
+
+    sharedNode = config.check("shared_node", Value(false)).asBool();
     yCInfo(RANGEFINDER2D_NWS_ROS) << "Frame_id is " << frame_id;
 
     return true;
@@ -85,17 +92,67 @@ bool Rangefinder2D_nws_ros::checkROSParams(yarp::os::Searchable &config)
 
 bool Rangefinder2D_nws_ros::initialize_ROS()
 {
-    node = new yarp::os::Node(nodeName);   // add a ROS node
+    // add a ROS node
+    node = sharedNode ? RosNodeRegistry::acquire(nodeName) : new yarp::os::Node(nodeName);
     if (node == nullptr)
     {
         yCError(RANGEFINDER2D_NWS_ROS) << " opening " << nodeName << " Node, check your yarp-ROS network configuration\n";
         return false;
     }
-    if (!publisherPort.topic(topicName))
+    if (!publisherPort.topic(sharedNode ? RosNodeRegistry::topicOnNode(topicName, nodeName) : topicName))
     {
         yCError(RANGEFINDER2D_NWS_ROS) << " opening " << topicName << " Topic, check your yarp-ROS network configuration\n";
         return false;
     }
+    for (auto& extra : extraScans)
+    {
+        extra.publisher = std::make_unique<yarp::os::Publisher<yarp::rosmsg::sensor_msgs::LaserScan>>();
+        if (!extra.publisher->topic(sharedNode ? RosNodeRegistry::topicOnNode(extra.topic, nodeName) : extra.topic))
+        {
+            yCError(RANGEFINDER2D_NWS_ROS) << " opening " << extra.topic << " Topic, check your yarp-ROS network configuration\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Rangefinder2D_nws_ros::parseExtraScans(yarp::os::Searchable &config)
+{
+    if (!config.check("extra_scans"))
+    {
+        return true;
+    }
+    yarp::os::Bottle* list = config.find("extra_scans").asList();
+    if (list == nullptr)
+    {
+        yCError(RANGEFINDER2D_NWS_ROS) << "extra_scans parameter must be a list";
+        return false;
+    }
+    for (size_t i = 0; i < list->size(); i++)
+    {
+        yarp::os::Bottle* elem = list->get(i).asList();
+        if (elem == nullptr || elem->size() != 4)
+        {
+            yCError(RANGEFINDER2D_NWS_ROS) << "Invalid element of extra_scans, expected (topic min_angle max_angle resolution)";
+            return false;
+        }
+        extraScan extra;
+        extra.topic = elem->get(0).asString();
+        extra.min_angle = elem->get(1).asFloat64();
+        extra.max_angle = elem->get(2).asFloat64();
+        extra.resolution = elem->get(3).asFloat64();
+        if (extra.topic.empty() || extra.topic[0] != '/')
+        {
+            yCError(RANGEFINDER2D_NWS_ROS) << "extra_scans topic must begin with an initial /";
+            return false;
+        }
+        if (extra.max_angle <= extra.min_angle || extra.resolution <= 0)
+        {
+            yCError(RANGEFINDER2D_NWS_ROS) << "Invalid angles or resolution for extra scan" << extra.topic;
+            return false;
+        }
+        extraScans.push_back(std::move(extra));
+    }
     return true;
 }
 
@@ -117,6 +174,13 @@ bool Rangefinder2D_nws_ros::attach(yarp::dev::PolyDriver* driver)
     }
     attach(sens_p);
 
+    //optional interface
+    driver->view(intensities_p);
+    if (intensities_p != nullptr)
+    {
+        yCInfo(RANGEFINDER2D_NWS_ROS) << "The attached device provides the intensities of the scan";
+    }
+
     if(!sens_p->getDistanceRange(minDistance, maxDistance))
     {
         yCError(RANGEFINDER2D_NWS_ROS) << "Laser device does not provide min & max distance range.";
@@ -135,10 +199,146 @@ bool Rangefinder2D_nws_ros::attach(yarp::dev::PolyDriver* driver)
         return false;
     }
 
+    updateRosTemplate();
+
     PeriodicThread::setPeriod(_period);
     return PeriodicThread::start();
 }
 
+void Rangefinder2D_nws_ros::updateRosTemplate(size_t scan_beams)
+{
+    rosTemplate.header.frame_id = frame_id;
+    rosTemplate.angle_min = minAngle * M_PI / 180.0;
+    rosTemplate.angle_max = maxAngle * M_PI / 180.0;
+    rosTemplate.angle_increment = resolution * M_PI / 180.0;
+    rosTemplate.time_increment = 0;             // all points in a single scan are considered took at the very same time
+    rosTemplate.scan_time = _period;            // time elapsed between two successive readings
+    rosTemplate.range_min = minDistance;
+    rosTemplate.range_max = maxDistance;
+
+    if (resolution <= 0)
+    {
+        return;
+    }
+    //before the first scan, the number of beams is computed from the limits and the resolution
+    int device_beams = (scan_beams > 0) ? static_cast<int>(scan_beams) : static_cast<int>(std::lround((maxAngle - minAngle) / resolution));
+    deviceBeams = static_cast<size_t>(std::max(device_beams, 0));
+    bool full_circle = (maxAngle - minAngle) >= 360.0 - resolution / 2;
+    for (auto& extra : extraScans)
+    {
+        //window, expressed in beams of the device
+        int first = static_cast<int>(std::ceil((extra.min_angle - minAngle) / resolution - 1e-6));
+        int last = static_cast<int>(std::floor((extra.max_angle - minAngle) / resolution + 1e-6));
+        if (!full_circle)
+        {
+            first = std::max(first, 0);
+            last = std::min(last, device_beams - 1);
+        }
+        else if (last - first + 1 > device_beams)
+        {
+            last = first + device_beams - 1;
+        }
+        extra.first_beam = first;
+        extra.beams = (last >= first) ? static_cast<size_t>(last - first + 1) : 0;
+        extra.decimation = static_cast<size_t>(std::max(1L, std::lround(extra.resolution / resolution)));
+        size_t out_beams = (extra.beams + extra.decimation - 1) / extra.decimation;
+        extra.selected.resize(out_beams);
+        if (extra.beams == 0)
+        {
+            yCWarning(RANGEFINDER2D_NWS_ROS) << "The window of extra scan" << extra.topic << "does not contain any beam of the device";
+        }
+
+        //each output beam is placed at the center of the group of beams it comes from
+        double first_center = minAngle + (first + (extra.decimation - 1) / 2.0) * resolution;
+        double increment = extra.decimation * resolution;
+        extra.rosTemplate = rosTemplate;
+        extra.rosTemplate.angle_min = first_center * M_PI / 180.0;
+        extra.rosTemplate.angle_max = (first_center + (out_beams > 0 ? out_beams - 1 : 0) * increment) * M_PI / 180.0;
+        extra.rosTemplate.angle_increment = increment * M_PI / 180.0;
+    }
+}
+
+void Rangefinder2D_nws_ros::decimateRangesToRos(const double* in, size_t in_size, int first_beam, size_t beams, size_t decimation, float* out, int* out_index)
+{
+    constexpr float inf = std::numeric_limits<float>::infinity();
+    int n = static_cast<int>(in_size);
+    size_t k = 0;
+    for (size_t start = 0; start < beams; start += decimation, k++)
+    {
+        size_t end = std::min(start + decimation, beams);
+        double best = std::numeric_limits<double>::infinity();
+        int best_index = -1;
+        for (size_t j = start; j < end; j++)
+        {
+            int idx = (first_beam + static_cast<int>(j)) % n;
+            if (idx < 0) { idx += n; }
+            if (!std::isnan(in[idx]) && (best_index < 0 || in[idx] < best))
+            {
+                best = in[idx];
+                best_index = idx;
+            }
+        }
+        out[k] = (best_index < 0) ? inf : static_cast<float>(best);
+        if (out_index) { out_index[k] = best_index; }
+    }
+}
+
+void Rangefinder2D_nws_ros::publishExtraScan(extraScan& extra, bool has_intensities)
+{
+    size_t out_beams = extra.selected.size();
+    yarp::rosmsg::sensor_msgs::LaserScan &rosData = extra.publisher->prepare();
+    rosData.header.seq = msgCounter;
+    rosData.header.stamp = lastStateStamp.getTime();
+    rosData.header.frame_id = extra.rosTemplate.header.frame_id;
+    rosData.angle_min = extra.rosTemplate.angle_min;
+    rosData.angle_max = extra.rosTemplate.angle_max;
+    rosData.angle_increment = extra.rosTemplate.angle_increment;
+    rosData.time_increment = extra.rosTemplate.time_increment;
+    rosData.scan_time = extra.rosTemplate.scan_time;
+    rosData.range_min = extra.rosTemplate.range_min;
+    rosData.range_max = extra.rosTemplate.range_max;
+    if (rosData.ranges.size() != out_beams)
+    {
+        rosData.ranges.resize(out_beams);
+    }
+    if (ranges.size() == 0)
+    {
+        std::fill(rosData.ranges.begin(), rosData.ranges.end(), std::numeric_limits<float>::infinity());
+        std::fill(extra.selected.begin(), extra.selected.end(), -1);
+    }
+    else
+    {
+        decimateRangesToRos(ranges.data(), ranges.size(), extra.first_beam, extra.beams, extra.decimation, rosData.ranges.data(), extra.selected.data());
+    }
+
+    if (has_intensities)
+    {
+        rosData.intensities.resize(out_beams);
+        for (size_t k = 0; k < out_beams; k++)
+        {
+            rosData.intensities[k] = (extra.selected[k] < 0) ? 0.0f : static_cast<float>(intensities[extra.selected[k]]);
+        }
+    }
+    else if (omitMissingIntensities)
+    {
+        rosData.intensities.clear();
+    }
+    else
+    {
+        rosData.intensities.assign(out_beams, 0.0);
+    }
+    extra.publisher->write();
+}
+
+void Rangefinder2D_nws_ros::convertRangesToRos(const double* in, float* out, size_t size)
+{
+    constexpr float inf = std::numeric_limits<float>::infinity();
+    for (size_t i = 0; i < size; i++)
+    {
+        out[i] = std::isnan(in[i]) ? inf : static_cast<float>(in[i]);
+    }
+}
+
 void Rangefinder2D_nws_ros::attach(yarp::dev::IRangefinder2D *s)
 {
     sens_p = s;
@@ -151,6 +351,7 @@ bool Rangefinder2D_nws_ros::detach()
         PeriodicThread::stop();
     }
     sens_p = nullptr;
+    intensities_p = nullptr;
     return true;
 }
 
@@ -171,6 +372,13 @@ bool Rangefinder2D_nws_ros::open(yarp::os::Searchable &config)
     }
     _period = config.find("period").asFloat64();
 
+    omitMissingIntensities = config.check("omit_missing_intensities", Value(false)).asBool();
+
+    if (!parseExtraScans(config))
+    {
+        return false;
+    }
+
     checkROSParams(config);
 
     // call ROS node/topic initialization, if needed
@@ -186,6 +394,10 @@ bool Rangefinder2D_nws_ros::open(yarp::os::Searchable &config)
 void Rangefinder2D_nws_ros::threadRelease()
 {
     publisherPort.close();
+    for (auto& extra : extraScans)
+    {
+        if (extra.publisher) { extra.publisher->close(); }
+    }
 }
 
 void Rangefinder2D_nws_ros::run()
@@ -194,9 +406,17 @@ void Rangefinder2D_nws_ros::run()
     {
         bool ret = true;
         IRangefinder2D::Device_status status;
-        yarp::sig::Vector ranges;
         double synchronized_timestamp=0;
-        ret &= sens_p->getRawData(ranges, &synchronized_timestamp);
+        bool has_intensities = false;
+        if (intensities_p != nullptr)
+        {
+            has_intensities = intensities_p->getRawDataWithIntensities(ranges, intensities, &synchronized_timestamp);
+            has_intensities &= (intensities.size() == ranges.size());
+        }
+        if (!has_intensities)
+        {
+            ret &= sens_p->getRawData(ranges, &synchronized_timestamp);
+        }
         ret &= sens_p->getDeviceStatus(status);
 
         if (ret)
@@ -210,40 +430,63 @@ void Rangefinder2D_nws_ros::run()
                 lastStateStamp.update(yarp::os::Time::now());
             }
 
-            int ranges_size = ranges.size();
+            size_t ranges_size = ranges.size();
 
             // publish ROS topic if required
             yarp::rosmsg::sensor_msgs::LaserScan &rosData = publisherPort.prepare();
-            rosData.header.seq = msgCounter++;
+            rosData.header.seq = msgCounter;
             rosData.header.stamp = lastStateStamp.getTime();
-            rosData.header.frame_id = frame_id;
-
-            rosData.angle_min = minAngle * M_PI / 180.0;
-            rosData.angle_max = maxAngle * M_PI / 180.0;
-            rosData.angle_increment = resolution * M_PI / 180.0;
-            rosData.time_increment = 0;             // all points in a single scan are considered took at the very same time
-            rosData.scan_time = getPeriod();        // time elapsed between two successive readings
-            rosData.range_min = minDistance;
-            rosData.range_max = maxDistance;
-            rosData.ranges.resize(ranges_size);
-            rosData.intensities.resize(ranges_size);
-
-            for (int i = 0; i < ranges_size; i++)
+            rosData.header.frame_id = rosTemplate.header.frame_id;
+
+            rosData.angle_min = rosTemplate.angle_min;
+            rosData.angle_max = rosTemplate.angle_max;
+            rosData.angle_increment = rosTemplate.angle_increment;
+            rosData.time_increment = rosTemplate.time_increment;
+            rosData.scan_time = rosTemplate.scan_time;
+            rosData.range_min = rosTemplate.range_min;
+            rosData.range_max = rosTemplate.range_max;
+            if (rosData.ranges.size() != ranges_size)
             {
-                // in yarp, NaN is used when a scan value is missing. For example when the angular range of the rangefinder is smaller than 360.
-                // is ros, NaN is not used. Hence this check replaces NaN with inf.
-                if (std::isnan(ranges[i]))
+                rosData.ranges.resize(ranges_size);
+            }
+            if (has_intensities)
+            {
+                rosData.intensities.resize(ranges_size);
+                std::copy(intensities.begin(), intensities.end(), rosData.intensities.begin());
+            }
+            else if (omitMissingIntensities)
+            {
+                rosData.intensities.clear();
+            }
+            else
+            {
+                rosData.intensities.assign(ranges_size, 0.0);
+            }
+
+            convertRangesToRos(ranges.data(), rosData.ranges.data(), ranges_size);
+            publisherPort.write();
+
+            //the windows of the extra scans are indices of the beams, valid only for scans of deviceBeams beams
+            if (!extraScans.empty() && ranges_size != 0 && ranges_size != deviceBeams)
+            {
+                yCInfo(RANGEFINDER2D_NWS_ROS) << "Scan of" << ranges_size << "beams, expected" << deviceBeams << ": the extra scans are computed again";
+                if (sens_p->getScanLimits(minAngle, maxAngle) && sens_p->getHorizontalResolution(resolution))
                 {
-                    rosData.ranges[i] = std::numeric_limits<double>::infinity();
-                    rosData.intensities[i] = 0.0;
+                    updateRosTemplate(ranges_size);
                 }
-                else
+            }
+            if (ranges_size == 0 || ranges_size == deviceBeams)
+            {
+                for (auto& extra : extraScans)
                 {
-                    rosData.ranges[i] = ranges[i];
-                    rosData.intensities[i] = 0.0;
+                    publishExtraScan(extra, has_intensities);
                 }
             }
-            publisherPort.write();
+            else if (!extraScans.empty())
+            {
+                yCError(RANGEFINDER2D_NWS_ROS) << "Unable to compute the extra scans for a scan of" << ranges_size << "beams, they are not published";
+            }
+            msgCounter++;
         }
         else
         {
@@ -260,8 +503,12 @@ bool Rangefinder2D_nws_ros::close()
         PeriodicThread::stop();
     }
     if(node!=nullptr) {
-        node->interrupt();
-        delete node;
+        if (sharedNode) {
+            RosNodeRegistry::release(node);
+        } else {
+            node->interrupt();
+            delete node;
+        }
         node = nullptr;
     }
 
@@ -8,6 +8,7 @@
 
  //#include <list>
 #include <vector>
+#include <memory>
 #include <iostream>
 #include <string>
 #include <sstream>
@@ -32,6 +33,9 @@
 #include <yarp/dev/WrapperSingle.h>
 #include <yarp/dev/api.h>
 
+#include <IRangefinder2DIntensities.h>
+#include <RosNodeRegistry.h>
+
 // ROS state publisher
 #include <yarp/os/Node.h>
 #include <yarp/os/Publisher.h>
@@ -56,9 +60,19 @@
    * | Parameter name  | SubParameter            | Type    | Units          | Default Value | Required                       | Description                                                           | Notes        |
    * |:---------------:|:-----------------------:|:-------:|:--------------:|:-------------:|:-----------------------------: |:---------------------------------------------------------------------:|:------------:|
    * | period          |      -                  | int     | ms             |   20          | No                             | refresh period of the broadcasted values in ms                        | default 20ms |
+   * | shared_node     |      -                  | bool    | -              |   false       | No                             | share the ROS node with the other devices of the process declaring the same node_name | the devices of other plugin libraries are included only on some platforms, see RosNodeRegistry |
    * | node_name       |      -                  | string  | -              |   -           | Yes                            | name of ROS node,  e.g. /myRobotName                                  | -           |
    * | topic_name      |      -                  | string  | -              |   -           | Yes                            | name of ROS topic, e.g. /Rangefinder2DSensor                          | -           |
    * | frame_id        |      -                  | string  | -              |   -           | Yes                            | name of the attached frame                                            | -           |
+   * | omit_missing_intensities | -              | bool    | -              |   false       | No                             | if the attached device does not provide intensities, publish an empty intensities array instead of a zero-filled one | -  |
+   * | extra_scans     |      -                  | list    | -              |   -           | No                             | additional reduced scans, published together with the full one. Format: ((topic min_angle max_angle resolution) ...), angles in deg | see below |
+   *
+   * If the attached device implements yarp::dev::IRangefinder2DIntensities, the intensities are read from it and published.
+   *
+   * Each element of extra_scans publishes, on its own topic, the beams of the window [min_angle, max_angle] (in the angular
+   * reference of the device, wrapping around if the device covers 360 deg). Groups of round(resolution / device resolution)
+   * consecutive beams are reduced to their minimum distance (missing values are ignored), and the ROS angle_min, angle_max
+   * and angle_increment refer to the center of each group.
    *
    * Example of configuration file using .ini format.
    *
@@ -69,6 +83,7 @@
    * node_name /<robotName>/Rangefinder2DSensor
    * topic_name /<robotName>/Rangefinder2DSensortopic
    * frame_id base
+   * extra_scans ((/<robotName>/Rangefinder2DSensortopic_front -90 90 1.0))
    * \endcode
    */
 class Rangefinder2D_nws_ros :
@@ -91,12 +106,34 @@ public:
     void threadRelease() override;
     void run() override;
 
+    /**
+     * Converts the ranges of a yarp scan in the ranges of a ROS scan.
+     * In yarp, NaN is used when a scan value is missing (for example when the angular range of the rangefinder is smaller than 360).
+     * In ROS, NaN is not used, hence NaN values are replaced with inf.
+     * The loop is branchless, so that the compiler can vectorize it.
+     */
+    static void convertRangesToRos(const double* in, float* out, size_t size);
+
+    /**
+     * Builds the ranges of a reduced ROS scan from the ranges of a yarp scan.
+     * @param in the yarp ranges
+     * @param in_size the number of yarp ranges
+     * @param first_beam the index of the first beam of the window. It can be negative or exceed in_size, and
+     * it is wrapped around in_size (the device is expected to cover 360 deg in this case)
+     * @param beams the number of beams of the window
+     * @param decimation the number of consecutive beams reduced to their minimum
+     * @param out the output ranges, ceil(beams / decimation) elements. Groups of missing values are converted to inf.
+     * @param out_index if not null, the index in the yarp scan of the beam selected for each element of out (-1 if none)
+     */
+    static void decimateRangesToRos(const double* in, size_t in_size, int first_beam, size_t beams, size_t decimation, float* out, int* out_index = nullptr);
+
 private:
     // ROS streaming data
     std::string                                               frame_id;          // name of the frame measures are referred to
     std::string                                               nodeName;          // name of the rosNode
     std::string                                               topicName;         // name of the rosTopic
     yarp::os::Node*                                           node;              // add a ROS node
+    bool                                                      sharedNode;        // node obtained from yarp::dev::RosNodeRegistry
     yarp::os::NetUint32                                       msgCounter;        // incremental counter in the ROS message
     yarp::os::Publisher<yarp::rosmsg::sensor_msgs::LaserScan> publisherPort;     // Dedicated ROS topic publisher
 
@@ -104,6 +141,7 @@ private:
     //interfaces
     yarp::dev::PolyDriver m_driver;
     yarp::dev::IRangefinder2D* sens_p;
+    yarp::dev::IRangefinder2DIntensities* intensities_p;
 
 private:
     //device data
@@ -112,11 +150,34 @@ private:
     double minAngle, maxAngle;
     double minDistance, maxDistance;
     double resolution;
+    bool omitMissingIntensities;
+    yarp::sig::Vector ranges;          // reused across cycles, to avoid reallocations
+    yarp::sig::Vector intensities;     // reused across cycles, to avoid reallocations
+    yarp::rosmsg::sensor_msgs::LaserScan rosTemplate; // fields which do not change between scans, computed at attach
+    size_t deviceBeams {0};            // size of the scans the windows of the extra scans are computed for
+
+    struct extraScan
+    {
+        std::string topic;
+        double      min_angle {0};   // requested window, deg
+        double      max_angle {0};   // requested window, deg
+        double      resolution {0};  // requested resolution, deg
+        int         first_beam {0};  // computed at attach
+        size_t      beams {0};       // computed at attach
+        size_t      decimation {1};  // computed at attach
+        std::vector<int> selected;   // reused across cycles
+        yarp::rosmsg::sensor_msgs::LaserScan rosTemplate;
+        std::unique_ptr<yarp::os::Publisher<yarp::rosmsg::sensor_msgs::LaserScan>> publisher;
+    };
+    std::vector<extraScan> extraScans;
 
 private:
     //private methods
     bool checkROSParams(yarp::os::Searchable &config);
     bool initialize_ROS();
+    void updateRosTemplate(size_t scan_beams = 0);
+    bool parseExtraScans(yarp::os::Searchable &config);
+    void publishExtraScan(extraScan& scan, bool has_intensities);
 };
 
 #endif //YARP_DEV_RANGEFINDER2D_NWS_ROS_H
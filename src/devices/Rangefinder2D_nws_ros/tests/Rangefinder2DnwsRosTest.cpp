@@ -0,0 +1,79 @@
+/*
+ * SPDX-FileCopyrightText: 2006-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "Rangefinder2D_nws_ros.h"
+
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <catch2/catch_amalgamated.hpp>
+#include <harness.h>
+
+TEST_CASE("dev::rangefinder2D_nws_ros_Test", "[yarp::dev]")
+{
+    SECTION("NaN ranges are converted to inf")
+    {
+        yarp::sig::Vector ranges(5);
+        ranges[0] = 1.0;
+        ranges[1] = std::numeric_limits<double>::quiet_NaN();
+        ranges[2] = 2.5;
+        ranges[3] = std::numeric_limits<double>::infinity();
+        ranges[4] = std::numeric_limits<double>::quiet_NaN();
+        std::vector<float> out(ranges.size());
+
+        Rangefinder2D_nws_ros::convertRangesToRos(ranges.data(), out.data(), ranges.size());
+
+        CHECK(out[0] == 1.0f);
+        CHECK(std::isinf(out[1]));
+        CHECK(out[2] == 2.5f);
+        CHECK(std::isinf(out[3]));
+        CHECK(std::isinf(out[4]));
+    }
+
+    SECTION("Windowed scans are min-pooled and wrap around")
+    {
+        const double nan = std::numeric_limits<double>::quiet_NaN();
+        yarp::sig::Vector ranges(8);
+        ranges[0] = 4.0; ranges[1] = 3.0; ranges[2] = nan; ranges[3] = 5.0;
+        ranges[4] = nan; ranges[5] = nan; ranges[6] = 2.0; ranges[7] = 1.0;
+        std::vector<float> out(3);
+        std::vector<int> index(3);
+
+        // beams 6,7 | 0,1 | 2 (window starting two beams before the first one)
+        Rangefinder2D_nws_ros::decimateRangesToRos(ranges.data(), ranges.size(), -2, 5, 2, out.data(), index.data());
+        CHECK(out[0] == 1.0f);
+        CHECK(index[0] == 7);
+        CHECK(out[1] == 3.0f);
+        CHECK(index[1] == 1);
+        CHECK(std::isinf(out[2]));
+        CHECK(index[2] == -1);
+
+        // beams 3,4,5: missing values are ignored
+        Rangefinder2D_nws_ros::decimateRangesToRos(ranges.data(), ranges.size(), 3, 3, 3, out.data(), index.data());
+        CHECK(out[0] == 5.0f);
+        CHECK(index[0] == 3);
+    }
+
+    SECTION("Benchmark of the ranges conversion")
+    {
+        for (size_t beams : {1440, 3600})
+        {
+            yarp::sig::Vector ranges(beams);
+            for (size_t i = 0; i < beams; i++) {
+                // one missing value every ten beams
+                ranges[i] = (i % 10 == 0) ? std::numeric_limits<double>::quiet_NaN() : 0.01 * i;
+            }
+            std::vector<float> out(beams);
+
+            BENCHMARK("convertRangesToRos " + std::to_string(beams) + " beams")
+            {
+                Rangefinder2D_nws_ros::convertRangesToRos(ranges.data(), out.data(), beams);
+                return out[beams - 1];
+            };
+        }
+    }
+}
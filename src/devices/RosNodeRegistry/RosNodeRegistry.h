@@ -0,0 +1,124 @@
+/*
+ * SPDX-FileCopyrightText: 2006-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef YARP_DEV_ROSNODEREGISTRY_H
+#define YARP_DEV_ROSNODEREGISTRY_H
+
+#include <yarp/os/Node.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#if defined(__GNUC__)
+#  define YARP_ROSNODEREGISTRY_API __attribute__((visibility("default")))
+#else
+#  define YARP_ROSNODEREGISTRY_API
+#endif
+
+namespace yarp::dev {
+
+/**
+ * Registry of reference counted yarp::os::Node, used by the devices
+ * of this repository which are configured with `shared_node true`: all of them
+ * declaring the same node name share a single node (and its XML-RPC server and
+ * threads) instead of creating one each.
+ *
+ * The storage is a static local of an inline function, so each library including
+ * this header has its own instance: the devices built into the same library (e.g.
+ * static plugins) always share their nodes. Among plugin libraries loaded
+ * separately the instance is shared only when the toolchain makes it unique in the
+ * process: GCC marks it STB_GNU_UNIQUE (hence the default visibility of the class),
+ * which the glibc dynamic linker binds to a single instance even for libraries
+ * loaded with RTLD_LOCAL. With other compilers (e.g. Clang, which does not emit
+ * STB_GNU_UNIQUE by default) and on macOS and Windows, each plugin library has its
+ * own registry, and a device shares its node only with the devices of its library.
+ */
+class YARP_ROSNODEREGISTRY_API RosNodeRegistry
+{
+public:
+    /**
+     * Returns the node with the given name, creating it if this is the first request.
+     * Each call must be matched by a call to release().
+     */
+    static yarp::os::Node* acquire(const std::string& name)
+    {
+        Storage& s = storage();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        Entry& entry = s.nodes[name];
+        if (!entry.node) {
+            entry.node = std::make_unique<yarp::os::Node>(name);
+        }
+        entry.refs++;
+        return entry.node.get();
+    }
+
+    /**
+     * Releases a node obtained with acquire(), the node is destroyed with its last user.
+     */
+    static void release(yarp::os::Node* node)
+    {
+        if (node == nullptr) {
+            return;
+        }
+        Storage& s = storage();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        for (auto it = s.nodes.begin(); it != s.nodes.end(); ++it) {
+            if (it->second.node.get() == node) {
+                if (--it->second.refs == 0) {
+                    it->second.node->interrupt();
+                    s.nodes.erase(it);
+                }
+                return;
+            }
+        }
+    }
+
+    /**
+     * Number of users of the node with the given name (0 if it does not exist).
+     */
+    static size_t users(const std::string& name)
+    {
+        Storage& s = storage();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto it = s.nodes.find(name);
+        return (it == s.nodes.end()) ? 0 : it->second.refs;
+    }
+
+    /**
+     * The name under which a topic must be opened to be bound to the given node,
+     * whichever node has been created last in the process.
+     */
+    static std::string topicOnNode(const std::string& topic, const std::string& nodeName)
+    {
+        return topic + "@" + nodeName;
+    }
+
+private:
+    struct Entry
+    {
+        std::unique_ptr<yarp::os::Node> node;
+        size_t refs {0};
+    };
+
+    struct Storage
+    {
+        std::mutex mutex;
+        std::map<std::string, Entry> nodes;
+    };
+
+    static Storage& storage()
+    {
+        static Storage s;
+        return s;
+    }
+};
+
+} // namespace yarp::dev
+
+#undef YARP_ROSNODEREGISTRY_API
+
+#endif // YARP_DEV_ROSNODEREGISTRY_H
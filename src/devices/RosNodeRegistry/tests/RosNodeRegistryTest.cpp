@@ -0,0 +1,106 @@
+/*
+ * SPDX-FileCopyrightText: 2006-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <RosNodeRegistry.h>
+
+#include <yarp/os/LogStream.h>
+#include <yarp/os/Network.h>
+#include <yarp/os/Node.h>
+#include <yarp/os/SystemClock.h>
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <catch2/catch_amalgamated.hpp>
+#include <harness.h>
+
+using namespace yarp::os;
+using yarp::dev::RosNodeRegistry;
+
+namespace {
+// Number of threads of the process, -1 where /proc is not available
+int threadCount()
+{
+    std::error_code ec;
+    std::filesystem::directory_iterator it("/proc/self/task", ec);
+    if (ec) {
+        return -1;
+    }
+    int count = 0;
+    for (; it != std::filesystem::directory_iterator(); ++it) {
+        count++;
+    }
+    return count;
+}
+} // namespace
+
+TEST_CASE("dev::RosNodeRegistry_Test", "[yarp::dev]")
+{
+    Network::setLocalMode(true);
+
+    SECTION("Nodes with the same name are shared and reference counted")
+    {
+        const std::string name = "/rosNodeRegistry_test";
+        Node* first = RosNodeRegistry::acquire(name);
+        Node* second = RosNodeRegistry::acquire(name);
+        Node* other = RosNodeRegistry::acquire(name + "_other");
+        CHECK(first != nullptr);
+        CHECK(first == second);
+        CHECK(first != other);
+        CHECK(RosNodeRegistry::users(name) == 2);
+
+        RosNodeRegistry::release(second);
+        CHECK(RosNodeRegistry::users(name) == 1);
+        RosNodeRegistry::release(first);
+        CHECK(RosNodeRegistry::users(name) == 0);
+        RosNodeRegistry::release(other);
+        CHECK(RosNodeRegistry::users(name + "_other") == 0);
+
+        CHECK(RosNodeRegistry::topicOnNode("/scan", "/robot") == "/scan@/robot");
+    }
+
+    SECTION("Startup time and thread count with 30 devices")
+    {
+        constexpr size_t devices = 30;
+
+        // one node per device, as each device does by default
+        int threadsBefore = threadCount();
+        double start = SystemClock::nowSystem();
+        std::vector<std::unique_ptr<Node>> ownNodes;
+        for (size_t i = 0; i < devices; i++) {
+            ownNodes.push_back(std::make_unique<Node>("/rosNodeRegistry_test_" + std::to_string(i)));
+        }
+        double ownTime = SystemClock::nowSystem() - start;
+        int ownThreads = threadCount() - threadsBefore;
+        for (auto& node : ownNodes) {
+            node->interrupt();
+        }
+        ownNodes.clear();
+
+        // one shared node
+        threadsBefore = threadCount();
+        start = SystemClock::nowSystem();
+        std::vector<Node*> sharedNodes;
+        for (size_t i = 0; i < devices; i++) {
+            sharedNodes.push_back(RosNodeRegistry::acquire("/rosNodeRegistry_test_shared"));
+        }
+        double sharedTime = SystemClock::nowSystem() - start;
+        int sharedThreads = threadCount() - threadsBefore;
+        CHECK(RosNodeRegistry::users("/rosNodeRegistry_test_shared") == devices);
+        for (auto* node : sharedNodes) {
+            RosNodeRegistry::release(node);
+        }
+
+        yInfo() << devices << "devices, own nodes:" << ownTime << "s," << ownThreads << "new threads";
+        yInfo() << devices << "devices, shared node:" << sharedTime << "s," << sharedThreads << "new threads";
+        if (ownThreads >= 0 && sharedThreads >= 0) {
+            CHECK(sharedThreads <= ownThreads);
+        }
+    }
+
+    Network::setLocalMode(false);
+}
@@ -13,6 +13,7 @@
 #include <yarp/os/ResourceFinder.h>
 #include <yarp/math/Math.h>
 
+#include <algorithm>
 #include <cmath>
 #include <cstring>
 #include <cstdlib>
@@ -74,30 +75,42 @@ double constrainAngle(double x)
 InputPortProcessor::InputPortProcessor()
 {
     m_contains_data=false;
+    m_new_data=false;
 }
 
 void InputPortProcessor::onRead(yarp::rosmsg::sensor_msgs::LaserScan& b)
 {
+    //the conversion is performed outside the mutex, on the back buffer
+    m_backScan.angle_max = b.angle_max;
+    m_backScan.angle_min = b.angle_min;
+    m_backScan.range_max = b.range_max;
+    m_backScan.range_min = b.range_min;
+    size_t ros_size = b.ranges.size();
+    if (ros_size != m_backScan.scans.size())
+    {
+        m_backScan.scans.resize (ros_size);
+    }
+    std::copy(b.ranges.begin(), b.ranges.end(), m_backScan.scans.begin());
+    if (b.intensities.size() != m_backIntensities.size())
+    {
+        m_backIntensities.resize(b.intensities.size());
+    }
+    std::copy(b.intensities.begin(), b.intensities.end(), m_backIntensities.begin());
+    m_backTiming.stamp = yarpStampFromROS(b.header.stamp);
+    m_backTiming.time_increment = b.time_increment;
+    m_backTiming.scan_time = b.scan_time;
+
     m_port_mutex.lock();
-        m_lastScan.angle_max = b.angle_max;
-        m_lastScan.angle_min = b.angle_min;
-        m_lastScan.range_max = b.range_max;
-        m_lastScan.range_min = b.range_min;
-        size_t ros_size = b.ranges.size();
-        if (ros_size != m_lastScan.scans.size())
-        {
-            m_lastScan.scans.resize (ros_size);
-        }
-        for (size_t i = 0; i < ros_size; i++)
-        {
-            m_lastScan.scans[i] = b.ranges[i];
-        }
+        std::swap(m_backScan, m_lastScan);
+        std::swap(m_backIntensities, m_lastIntensities);
+        m_lastTiming = m_backTiming;
         getEnvelope(m_lastStamp);
         m_contains_data=true;
+        m_new_data=true;
     m_port_mutex.unlock();
 }
 
-inline void InputPortProcessor::getLast(yarp::dev::LaserScan2D& data, Stamp& stmp)
+bool InputPortProcessor::getLast(yarp::dev::LaserScan2D& data, yarp::sig::Vector& intensities, Stamp& stmp, scan_timing& timing)
 {
     //this blocks untils the first data is received;
     size_t counter =0;
@@ -107,10 +120,37 @@ inline void InputPortProcessor::getLast(yarp::dev::LaserScan2D& data, Stamp& stm
         if (counter++ > 100) {yDebug() << "Waiting for incoming data..."; counter=0;}
     }
 
-    m_port_mutex.lock();
-        data = m_lastScan;
-        stmp = m_lastStamp;
-    m_port_mutex.unlock();
+    std::lock_guard<std::mutex> guard(m_port_mutex);
+    stmp = m_lastStamp;
+    timing = m_lastTiming;
+    if (m_new_data == false)
+    {
+        return false;
+    }
+    //the previous buffer of the reader is given back and will be reused by onRead()
+    std::swap(data, m_lastScan);
+    std::swap(intensities, m_lastIntensities);
+    m_new_data = false;
+    return true;
+}
+
+void OdometryInputProcessor::onRead(yarp::rosmsg::nav_msgs::Odometry& v)
+{
+    std::lock_guard<std::mutex> guard(m_port_mutex);
+    //the twist of a nav_msgs/Odometry is expressed in the child (base) frame
+    m_vel_x = v.twist.twist.linear.x;
+    m_vel_y = v.twist.twist.linear.y;
+    m_vel_theta = v.twist.twist.angular.z;
+    m_contains_data = true;
+}
+
+bool OdometryInputProcessor::getLast(double& vel_x, double& vel_y, double& vel_theta)
+{
+    std::lock_guard<std::mutex> guard(m_port_mutex);
+    vel_x = m_vel_x;
+    vel_y = m_vel_y;
+    vel_theta = m_vel_theta;
+    return m_contains_data;
 }
 
 //-------------------------------------------------------------------------------------
@@ -153,6 +193,9 @@ bool LaserFromRosTopic::open(yarp::os::Searchable& config)
         }
         m_last_stamp.resize(m_port_names.size());
         m_last_scan_data.resize(m_port_names.size());
+        m_last_timing.resize(m_port_names.size());
+        m_last_intensities.resize(m_port_names.size());
+        m_transforms.resize(m_port_names.size(), yarp::sig::Matrix(4, 4));
     }
 
     if (general_config.check("base_type")) //this parameter is optional
@@ -166,24 +209,17 @@ bool LaserFromRosTopic::open(yarp::os::Searchable& config)
     }
 
     //set the base value
-    m_empty_laser_data = m_laser_data;
     if (m_base_type == base_enum::BASE_IS_INF)
     {
-        for (size_t i = 0; i < m_empty_laser_data.size(); i++) {
-            m_empty_laser_data[i] = std::numeric_limits<double>::infinity();
-        }
+        m_base_value = std::numeric_limits<double>::infinity();
     }
     else if (m_base_type == base_enum::BASE_IS_NAN)
     {
-        for (size_t i = 0; i < m_empty_laser_data.size(); i++) {
-            m_empty_laser_data[i] = std::nanf("");
-        }
+        m_base_value = std::numeric_limits<double>::quiet_NaN();
     }
     else if (m_base_type == base_enum::BASE_IS_ZERO)
     {
-        for (size_t i = 0; i < m_empty_laser_data.size(); i++) {
-            m_empty_laser_data[i] = 0;
-        }
+        m_base_value = 0;
     }
     else
     {
@@ -204,6 +240,31 @@ bool LaserFromRosTopic::open(yarp::os::Searchable& config)
         }
     }
 
+    //motion compensation
+    if (config.check("DESKEW"))
+    {
+        yarp::os::Searchable& deskew_config = config.findGroup("DESKEW");
+        m_deskew_enabled = true;
+        std::string ts = deskew_config.check("twist_source", Value("odometry")).asString();
+        if (ts == "odometry") { m_twist_source = twist_source_enum::TWIST_FROM_ODOMETRY; }
+        else if (ts == "transform") { m_twist_source = twist_source_enum::TWIST_FROM_TRANSFORM; }
+        else { yCError(LASER_FROM_ROS_TOPIC) << "Invalid value of param twist_source"; return false;
+        }
+        m_odometry_topic = deskew_config.check("odometry_topic", Value(m_odometry_topic)).asString();
+        m_odom_frame_id = deskew_config.check("odom_frame", Value(m_odom_frame_id)).asString();
+        m_max_extrapolation = deskew_config.check("max_extrapolation", Value(m_max_extrapolation)).asFloat64();
+        if (m_max_extrapolation < 0)
+        {
+            yCError(LASER_FROM_ROS_TOPIC) << "Invalid value of param max_extrapolation";
+            return false;
+        }
+        if (m_option_override_limits)
+        {
+            yCError(LASER_FROM_ROS_TOPIC) << "option override cannot be used together with the DESKEW group";
+            return false;
+        }
+    }
+
     //open the tc client
     if (config.check("TRANSFORMS") && config.check("TRANSFORM_CLIENT"))
     {
@@ -271,6 +332,24 @@ bool LaserFromRosTopic::open(yarp::os::Searchable& config)
         }
         m_input_ports[i].useCallback();    ///@@@<-OK
     }
+
+    if (m_deskew_enabled)
+    {
+        if (m_twist_source == twist_source_enum::TWIST_FROM_TRANSFORM && m_iTc == nullptr)
+        {
+            yCError(LASER_FROM_ROS_TOPIC) << "twist_source transform requires the TRANSFORMS and TRANSFORM_CLIENT groups";
+            return false;
+        }
+        if (m_twist_source == twist_source_enum::TWIST_FROM_ODOMETRY)
+        {
+            if (m_odometry_port.topic(m_odometry_topic) == false)
+            {
+                yCError(LASER_FROM_ROS_TOPIC) << "Error opening port:" << m_odometry_topic;
+                return false;
+            }
+            m_odometry_port.useCallback();
+        }
+    }
     PeriodicThread::start();
 
     yInfo("LaserFromRosTopic: Sensor ready");
@@ -285,6 +364,7 @@ bool LaserFromRosTopic::close()
     {
         it->close();
     }
+    m_odometry_port.close();
     if (m_ros_node) { delete m_ros_node; m_ros_node = nullptr; }
 
     yCInfo(LASER_FROM_ROS_TOPIC) << "LaserFromRosTopic closed";
@@ -326,6 +406,22 @@ bool LaserFromRosTopic::setScanRate(double rate)
 
 
 
+bool LaserFromRosTopic::getRawDataWithIntensities(yarp::sig::Vector& ranges, yarp::sig::Vector& intensities, double* timestamp)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (m_intensities_available == false)
+    {
+        return false;
+    }
+    ranges = m_laser_data;
+    intensities = m_laser_intensities;
+    if (timestamp != nullptr)
+    {
+        *timestamp = m_timestamp.getTime();
+    }
+    return true;
+}
+
 bool LaserFromRosTopic::threadInit()
 {
 #ifdef LASER_DEBUG
@@ -336,11 +432,68 @@ bool LaserFromRosTopic::threadInit()
     return true;
 }
 
-void LaserFromRosTopic::calculate(yarp::dev::LaserScan2D scan_data, yarp::sig::Matrix m)
+void LaserFromRosTopic::updateTwist()
+{
+    if (m_twist_source == twist_source_enum::TWIST_FROM_ODOMETRY)
+    {
+        if (!m_odometry_port.getLast(m_vel_x, m_vel_y, m_vel_theta))
+        {
+            m_vel_x = m_vel_y = m_vel_theta = 0;
+        }
+        return;
+    }
+
+    //differentiate the pose of the dst frame w.r.t. the fixed odom frame
+    yarp::sig::Matrix& m = m_odom_transform; m.eye();
+    if (m_iTc->getTransform(m_dst_frame_id, m_odom_frame_id, m) == false)
+    {
+        yCWarning(LASER_FROM_ROS_TOPIC) << "Unable to find the transform between" << m_dst_frame_id << "and" << m_odom_frame_id;
+        m_prev_pose_valid = false;
+        m_vel_x = m_vel_y = m_vel_theta = 0;
+        return;
+    }
+    double now = yarp::os::Time::now();
+    double x = m[0][3];
+    double y = m[1][3];
+    double theta = atan2(m[1][0], m[0][0]);
+    double dt = now - m_prev_pose_time;
+    if (m_prev_pose_valid && dt > 0)
+    {
+        //displacement expressed in the previous dst frame
+        double c = cos(m_prev_pose_theta);
+        double s = sin(m_prev_pose_theta);
+        double dx = x - m_prev_pose_x;
+        double dy = y - m_prev_pose_y;
+        double dtheta = remainder(theta - m_prev_pose_theta, 2 * M_PI);
+        m_vel_x = (c * dx + s * dy) / dt;
+        m_vel_y = (-s * dx + c * dy) / dt;
+        m_vel_theta = dtheta / dt;
+    }
+    m_prev_pose_x = x;
+    m_prev_pose_y = y;
+    m_prev_pose_theta = theta;
+    m_prev_pose_time = now;
+    m_prev_pose_valid = true;
+}
+
+void LaserFromRosTopic::resetLaserData()
+{
+    std::fill(m_laser_data.begin(), m_laser_data.end(), m_base_value);
+    if (m_laser_intensities.size() != m_laser_data.size())
+    {
+        m_laser_intensities.resize(m_laser_data.size());
+    }
+    std::fill(m_laser_intensities.begin(), m_laser_intensities.end(), 0.0);
+    m_intensities_available = true;
+}
+
+void LaserFromRosTopic::calculate(const yarp::dev::LaserScan2D& scan_data, const yarp::sig::Vector& intensities, const yarp::sig::Matrix& m, const scan_timing& timing)
 {
-    yarp::sig::Vector temp(3);
-    temp = yarp::math::dcm2rpy(m);
-    double t_off_rad = temp[2];
+    bool has_intensities = (intensities.size() == scan_data.scans.size());
+    m_intensities_available &= has_intensities;
+
+    //yaw of the transform, as computed by yarp::math::dcm2rpy(), without allocating a vector
+    double t_off_rad = atan2(m[1][0], m[0][0]);
     double x_off = m[0][3];
     double y_off = m[1][3];
 
@@ -377,8 +530,21 @@ void LaserFromRosTopic::calculate(yarp::dev::LaserScan2D scan_data, yarp::sig::M
             //calculate vertical and horizontal components of new angle with offset.
             double By = Ay + y_off;
             double Bx = Ax + x_off;
+            double rot_comp_rad = 0;
+
+            if (m_deskew_enabled)
+            {
+                //bring the point to the reference time, assuming a constant twist of the dst frame.
+                //The rotation does not change the distance, so it is applied directly on the output angle.
+                double dt = m_reference_time - (timing.stamp + i * timing.time_increment);
+                if (dt > m_max_extrapolation) { dt = m_max_extrapolation; }
+                else if (dt < -m_max_extrapolation) { dt = -m_max_extrapolation; }
+                Bx -= m_vel_x * dt;
+                By -= m_vel_y * dt;
+                rot_comp_rad = m_vel_theta * dt;
+            }
 
-            double angle_output_rad = atan2(By, Bx); //the output is (-pi +pi)
+            double angle_output_rad = atan2(By, Bx) - rot_comp_rad; //the output is (-pi-rot_comp +pi-rot_comp)
             double angle_output_deg = angle_output_rad * RAD2DEG; //the output is (-180 +180)
             angle_output_deg = constrainAngle(angle_output_deg); //the output is (0 360(
 
@@ -397,13 +563,13 @@ void LaserFromRosTopic::calculate(yarp::dev::LaserScan2D scan_data, yarp::sig::M
             double newdistance = std::sqrt((Bx * Bx) + (By * By));
 
             //assignment on empty (nan) slots or in valid slots if distance is shorter
-            if (std::isnan(m_laser_data[new_i]))
-            {
-                m_laser_data[new_i] = newdistance;
-            }
-            else if (newdistance < m_laser_data[new_i])
+            if (std::isnan(m_laser_data[new_i]) || newdistance < m_laser_data[new_i])
             {
                 m_laser_data[new_i] = newdistance;
+                if (has_intensities)
+                {
+                    m_laser_intensities[new_i] = intensities[i];
+                }
             }
         }
     }
@@ -415,12 +581,47 @@ bool LaserFromRosTopic::acquireDataFromHW()
     double t1 = yarp::os::Time::now();
 #endif
     std::lock_guard<std::mutex> guard(m_mutex);
-    m_laser_data = m_empty_laser_data;
 
     size_t nports = m_input_ports.size();
-    if (nports == 1) //one single port, optimes version
+    if (m_deskew_enabled)
+    {
+        //all the scans are needed in advance to compute the common reference time
+        m_reference_time = 0;
+        for (size_t i = 0; i < nports; i++)
+        {
+            m_input_ports[i].getLast(m_last_scan_data[i], m_last_intensities[i], m_last_stamp[i], m_last_timing[i]);
+            double last_beam_time = m_last_timing[i].stamp;
+            if (m_last_scan_data[i].scans.size() > 0)
+            {
+                last_beam_time += (m_last_scan_data[i].scans.size() - 1) * m_last_timing[i].time_increment;
+            }
+            if (last_beam_time > m_reference_time) { m_reference_time = last_beam_time; }
+        }
+        updateTwist();
+
+        resetLaserData();
+        for (size_t i = 0; i < nports; i++)
+        {
+            yarp::sig::Matrix& m = m_transforms[i]; m.eye();
+            if (m_iTc)
+            {
+                bool frame_exists = m_iTc->getTransform(m_src_frame_id[i], m_dst_frame_id, m);
+                if (frame_exists == false)
+                {
+                    yCWarning(LASER_FROM_ROS_TOPIC) << "Unable to found m matrix between" << m_src_frame_id[i] << "and" << m_dst_frame_id;
+                }
+            }
+            calculate(m_last_scan_data[i], m_last_intensities[i], m, m_last_timing[i]);
+        }
+    }
+    else if (nports == 1) //one single port, optimes version
     {
-        m_input_ports[0].getLast(m_last_scan_data[0], m_last_stamp[0]);
+        bool new_data = m_input_ports[0].getLast(m_last_scan_data[0], m_last_intensities[0], m_last_stamp[0], m_last_timing[0]);
+        if (new_data == false && m_iTc == nullptr)
+        {
+            //m_laser_data still contains the last received scan
+            return true;
+        }
         size_t received_scans = m_last_scan_data[0].scans.size();
 
         if (m_option_override_limits)
@@ -439,34 +640,47 @@ bool LaserFromRosTopic::acquireDataFromHW()
 
         if (m_iTc == nullptr)
         {
-            for (size_t elem = 0; elem < m_sensorsNum; elem++)
+            if (received_scans == m_laser_data.size())
+            {
+                //the scan is owned by this thread: take it instead of copying it.
+                //The previous buffer goes back to the input port, to be reused.
+                std::swap(m_laser_data, m_last_scan_data[0].scans);
+                std::swap(m_laser_intensities, m_last_intensities[0]);
+                m_intensities_available = (m_laser_intensities.size() == m_laser_data.size());
+            }
+            else
             {
-                m_laser_data[elem] = m_last_scan_data[0].scans[elem]; //m
+                size_t elems = std::min(received_scans, m_laser_data.size());
+                std::copy(m_last_scan_data[0].scans.begin(), m_last_scan_data[0].scans.begin() + elems, m_laser_data.begin());
+                std::fill(m_laser_data.begin() + elems, m_laser_data.end(), m_base_value);
+                m_intensities_available = false;
             }
         }
         else
         {
-            yarp::sig::Matrix m(4, 4); m.eye();
+            yarp::sig::Matrix& m = m_transforms[0]; m.eye();
             bool frame_exists = m_iTc->getTransform(m_src_frame_id[0], m_dst_frame_id, m);
             if (frame_exists == false)
             {
                 yCWarning(LASER_FROM_ROS_TOPIC) << "Unable to found m matrix" << "and" << m_dst_frame_id;
             }
-            calculate(m_last_scan_data[0], m);
+            resetLaserData();
+            calculate(m_last_scan_data[0], m_last_intensities[0], m, m_last_timing[0]);
         }
     }
     else //multiple ports
     {
+        resetLaserData();
         for (size_t i = 0; i < nports; i++)
         {
-            yarp::sig::Matrix m(4, 4); m.eye();
+            yarp::sig::Matrix& m = m_transforms[i]; m.eye();
             bool frame_exists = m_iTc->getTransform(m_src_frame_id[i], m_dst_frame_id, m);
             if (frame_exists == false)
             {
                 yCWarning(LASER_FROM_ROS_TOPIC) << "Unable to found m matrix between" << "and" << m_dst_frame_id;
             }
-            m_input_ports[i].getLast(m_last_scan_data[i], m_last_stamp[i]);
-            calculate(m_last_scan_data[i], m);
+            m_input_ports[i].getLast(m_last_scan_data[i], m_last_intensities[i], m_last_stamp[i], m_last_timing[i]);
+            calculate(m_last_scan_data[i], m_last_intensities[i], m, m_last_timing[i]);
         }
     }
 
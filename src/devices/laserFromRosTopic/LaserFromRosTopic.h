@@ -20,12 +20,16 @@
 #include <yarp/dev/IFrameTransform.h>
 #include <yarp/dev/PolyDriver.h>
 
+#include <IRangefinder2DIntensities.h>
+
  // ROS state publisher
 #include <yarp/os/Node.h>
 #include <yarp/os/Subscriber.h>
 #include <yarp/rosmsg/sensor_msgs/LaserScan.h>
+#include <yarp/rosmsg/nav_msgs/Odometry.h>
 #include <yarp/rosmsg/impl/yarpRosHelper.h>
 
+#include <limits>
 #include <mutex>
 #include <string>
 #include <vector>
@@ -40,35 +44,106 @@ enum base_enum
     BASE_IS_ZERO = 2
 };
 
+enum twist_source_enum
+{
+    TWIST_FROM_ODOMETRY = 0,
+    TWIST_FROM_TRANSFORM = 1
+};
+
+struct scan_timing
+{
+    double stamp = 0;          // acquisition time of the first beam, taken from the ROS header (s)
+    double time_increment = 0; // time elapsed between two consecutive beams (s)
+    double scan_time = 0;      // time elapsed between two consecutive scans (s)
+};
+
+/**
+ * Receives the scans of a single ROS topic.
+ * onRead() converts each scan once into a private back buffer, which is then swapped with the
+ * shared front buffer. getLast() swaps the front buffer with the buffer of the reader, so that
+ * no copy of the ranges is performed and no memory is allocated once the sizes are stable.
+ * The intensities of the scan, if present, follow the same path.
+ */
 class InputPortProcessor :
     public yarp::os::Subscriber<yarp::rosmsg::sensor_msgs::LaserScan>
 {
     std::mutex             m_port_mutex;
+    yarp::dev::LaserScan2D m_backScan;         // only accessed by onRead()
+    yarp::sig::Vector      m_backIntensities;  // only accessed by onRead()
+    scan_timing            m_backTiming;       // only accessed by onRead()
     yarp::dev::LaserScan2D m_lastScan;
+    yarp::sig::Vector      m_lastIntensities;
     yarp::os::Stamp        m_lastStamp;
+    scan_timing            m_lastTiming;
     bool                   m_contains_data;
+    bool                   m_new_data;
 
 public:
     InputPortProcessor(const InputPortProcessor& alt) :
             yarp::os::Subscriber<yarp::rosmsg::sensor_msgs::LaserScan>(),
+            m_backScan(alt.m_backScan),
+            m_backIntensities(alt.m_backIntensities),
+            m_backTiming(alt.m_backTiming),
             m_lastScan(alt.m_lastScan),
+            m_lastIntensities(alt.m_lastIntensities),
             m_lastStamp(alt.m_lastStamp),
-            m_contains_data(alt.m_contains_data)
+            m_lastTiming(alt.m_lastTiming),
+            m_contains_data(alt.m_contains_data),
+            m_new_data(alt.m_new_data)
     {
     }
 
     InputPortProcessor();
     using yarp::os::Subscriber<yarp::rosmsg::sensor_msgs::LaserScan>::onRead;
     virtual void onRead(yarp::rosmsg::sensor_msgs::LaserScan& v) override;
-    void getLast(yarp::dev::LaserScan2D& data, yarp::os::Stamp& stmp);
+
+    /**
+     * Blocks until the first scan is received, then exchanges the latest scan with the content of data.
+     * intensities is empty if the received scan does not carry them.
+     * @return true if data has been updated, false if no new scan arrived since the previous call
+     * (in that case data is left untouched, and it still contains the latest scan).
+     */
+    bool getLast(yarp::dev::LaserScan2D& data, yarp::sig::Vector& intensities, yarp::os::Stamp& stmp, scan_timing& timing);
+};
+
+class OdometryInputProcessor :
+    public yarp::os::Subscriber<yarp::rosmsg::nav_msgs::Odometry>
+{
+    std::mutex             m_port_mutex;
+    double                 m_vel_x = 0;     // m/s, base frame
+    double                 m_vel_y = 0;     // m/s, base frame
+    double                 m_vel_theta = 0; // rad/s
+    bool                   m_contains_data = false;
+
+public:
+    using yarp::os::Subscriber<yarp::rosmsg::nav_msgs::Odometry>::onRead;
+    virtual void onRead(yarp::rosmsg::nav_msgs::Odometry& v) override;
+    bool getLast(double& vel_x, double& vel_y, double& vel_theta);
 };
 
 /**
  * @ingroup dev_impl_lidar
  *
  * \brief `laserFromRosTopic`: Documentation to be added
+ *
+ * The intensities of the input scans are merged together with the ranges (each output slot takes the
+ * intensity of the nearest return) and they are exposed through yarp::dev::IRangefinder2DIntensities,
+ * when all the inputs provide them.
+ *
+ * Optional parameters of the DESKEW group (motion compensation of the merged scans):
+ * | Parameter name | SubParameter      | Type    | Units | Default Value | Required | Description                                                                 |
+ * |:--------------:|:-----------------:|:-------:|:-----:|:-------------:|:--------:|:---------------------------------------------------------------------------:|
+ * | DESKEW         | twist_source      | string  | -     | odometry      | No       | `odometry` (reads a nav_msgs/Odometry topic) or `transform` (differentiates the IFrameTransform pose of dst_frame) |
+ * | DESKEW         | odometry_topic    | string  | -     | /odom         | No       | topic used when twist_source is `odometry`                                   |
+ * | DESKEW         | odom_frame        | string  | -     | odom          | No       | fixed frame used when twist_source is `transform`                            |
+ * | DESKEW         | max_extrapolation | double  | s     | 0.5           | No       | beams older/newer than this w.r.t. the reference time are compensated by this amount only |
+ *
+ * When the DESKEW group is present, every beam is brought to the acquisition time of the most recent beam
+ * received across all the inputs, using its own timestamp (header stamp + index * time_increment)
+ * and a planar constant-twist motion model of the dst_frame.
  */
 class LaserFromRosTopic : public yarp::dev::Lidar2DDeviceBase,
+                              public yarp::dev::IRangefinder2DIntensities,
                               public yarp::os::PeriodicThread,
                               public yarp::dev::DeviceDriver
 {
@@ -79,21 +154,47 @@ protected:
     std::vector<InputPortProcessor> m_input_ports;
     std::vector <yarp::os::Stamp>        m_last_stamp;
     std::vector <yarp::dev::LaserScan2D> m_last_scan_data;
+    std::vector <yarp::sig::Vector>      m_last_intensities;
+    yarp::sig::Vector                    m_laser_intensities;
+    bool                                 m_intensities_available = false;
     yarp::dev::PolyDriver                m_tc_driver;
     yarp::dev::IFrameTransform*          m_iTc = nullptr;
 
     std::vector <std::string>            m_src_frame_id;
     std::string                          m_dst_frame_id;
-    yarp::sig::Vector                    m_empty_laser_data;
+    std::vector <yarp::sig::Matrix>      m_transforms;
+    double                               m_base_value;
     base_enum                            m_base_type;
 
-    void calculate(yarp::dev::LaserScan2D scan, yarp::sig::Matrix m);
+    //deskew
+    bool                                 m_deskew_enabled = false;
+    twist_source_enum                    m_twist_source = twist_source_enum::TWIST_FROM_ODOMETRY;
+    std::string                          m_odometry_topic = "/odom";
+    std::string                          m_odom_frame_id = "odom";
+    double                               m_max_extrapolation = 0.5;
+    OdometryInputProcessor               m_odometry_port;
+    std::vector <scan_timing>            m_last_timing;
+    double                               m_reference_time = 0;
+    double                               m_vel_x = 0;
+    double                               m_vel_y = 0;
+    double                               m_vel_theta = 0;
+    bool                                 m_prev_pose_valid = false;
+    double                               m_prev_pose_x = 0;
+    double                               m_prev_pose_y = 0;
+    double                               m_prev_pose_theta = 0;
+    double                               m_prev_pose_time = 0;
+    yarp::sig::Matrix                    m_odom_transform = yarp::sig::Matrix(4, 4);
+
+    void calculate(const yarp::dev::LaserScan2D& scan, const yarp::sig::Vector& intensities, const yarp::sig::Matrix& m, const scan_timing& timing);
+    void resetLaserData();
+    void updateTwist();
 
 public:
     LaserFromRosTopic(double period = 0.01) : Lidar2DDeviceBase(), PeriodicThread(period)
     {
         m_option_override_limits=false;
         m_base_type = base_enum::BASE_IS_NAN;
+        m_base_value = std::numeric_limits<double>::quiet_NaN();
     }
 
     ~LaserFromRosTopic()
@@ -113,6 +214,10 @@ public:
     bool setHorizontalResolution (double step) override;
     bool setScanRate             (double rate) override;
 
+public:
+    //IRangefinder2DIntensities interface
+    bool getRawDataWithIntensities(yarp::sig::Vector& ranges, yarp::sig::Vector& intensities, double* timestamp = nullptr) override;
+
 public:
     //Lidar2DDeviceBase
     bool acquireDataFromHW() override final;
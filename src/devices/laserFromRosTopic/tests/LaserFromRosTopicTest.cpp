@@ -0,0 +1,211 @@
+/*
+ * SPDX-FileCopyrightText: 2006-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "LaserFromRosTopic.h"
+
+#include <yarp/dev/IFrameTransform.h>
+#include <yarp/math/Quaternion.h>
+#include <yarp/os/Network.h>
+#include <yarp/os/Stamp.h>
+#include <yarp/sig/Matrix.h>
+
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#include <catch2/catch_amalgamated.hpp>
+#include <harness.h>
+
+using namespace yarp::dev;
+using namespace yarp::os;
+
+// Counts all the heap allocations performed by the process
+static std::atomic<size_t> allocation_count {0};
+
+void* operator new(std::size_t size)
+{
+    allocation_count++;
+    void* p = std::malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace {
+// Each source frame is translated along x by its index, the matrix is filled in place
+class FakeFrameTransform : public IFrameTransform
+{
+public:
+    size_t lookups = 0;
+
+    bool getTransform(const std::string& target_frame_id, const std::string& source_frame_id, yarp::sig::Matrix& transform) override
+    {
+        lookups++;
+        transform.eye();
+        transform[0][3] = (source_frame_id == "laser_1") ? 0.5 : 0.0;
+        return true;
+    }
+
+    bool allFramesAsString(std::string& all_frames) override { return false; }
+    bool canTransform(const std::string& target_frame, const std::string& source_frame) override { return true; }
+    bool clear() override { return true; }
+    bool frameExists(const std::string& frame_id) override { return true; }
+    bool getAllFrameIds(std::vector<std::string>& ids) override { return false; }
+    bool getParent(const std::string& frame_id, std::string& parent_frame_id) override { return false; }
+    bool setTransform(const std::string& target_frame_id, const std::string& source_frame_id, const yarp::sig::Matrix& transform) override { return false; }
+    bool setTransformStatic(const std::string& target_frame_id, const std::string& source_frame_id, const yarp::sig::Matrix& transform) override { return false; }
+    bool deleteTransform(const std::string& target_frame_id, const std::string& source_frame_id) override { return false; }
+    bool transformPoint(const std::string& target_frame_id, const std::string& source_frame_id, const yarp::sig::Vector& input_point, yarp::sig::Vector& transformed_point) override { return false; }
+    bool transformPose(const std::string& target_frame_id, const std::string& source_frame_id, const yarp::sig::Vector& input_pose, yarp::sig::Vector& transformed_pose) override { return false; }
+    bool transformQuaternion(const std::string& target_frame_id, const std::string& source_frame_id, const yarp::math::Quaternion& input_quaternion, yarp::math::Quaternion& transformed_quaternion) override { return false; }
+    bool waitForTransform(const std::string& target_frame_id, const std::string& source_frame_id, const double& timeout) override { return true; }
+};
+
+// Sets up the inputs and the transforms as open() does, without the topics and the transform client
+class TestLaserFromRosTopic : public LaserFromRosTopic
+{
+public:
+    void setup(size_t nports, size_t nbeams, IFrameTransform* iTc)
+    {
+        m_input_ports.resize(nports);
+        m_last_stamp.resize(nports);
+        m_last_scan_data.resize(nports);
+        m_last_timing.resize(nports);
+        m_last_intensities.resize(nports);
+        m_transforms.resize(nports, yarp::sig::Matrix(4, 4));
+        for (size_t i = 0; i < nports; i++) {
+            m_src_frame_id.push_back("laser_" + std::to_string(i));
+        }
+        m_dst_frame_id = "base";
+        m_iTc = iTc;
+        m_sensorsNum = nbeams;
+        m_min_angle = 0;
+        m_max_angle = 360;
+        m_resolution = 360.0 / nbeams;
+        m_laser_data.resize(nbeams);
+    }
+
+    InputPortProcessor& input(size_t i) { return m_input_ports[i]; }
+    const yarp::sig::Vector& laserData() const { return m_laser_data; }
+};
+} // namespace
+
+TEST_CASE("dev::laserFromRosTopic_Test", "[yarp::dev]")
+{
+    Network::setLocalMode(true);
+
+    SECTION("Steady-state scan exchange does not allocate")
+    {
+        const size_t nbeams = 1440;
+        const size_t ncycles = 100;
+
+        InputPortProcessor proc;
+        yarp::rosmsg::sensor_msgs::LaserScan msg;
+        msg.angle_min = 0;
+        msg.angle_max = 360;
+        msg.range_min = 0.1;
+        msg.range_max = 30;
+        msg.ranges.resize(nbeams, 1.0);
+        msg.intensities.resize(nbeams, 100.0);
+
+        LaserScan2D reader;
+        yarp::sig::Vector intensities;
+        Stamp stamp;
+        scan_timing timing;
+
+        // Warm up: all the buffers of the rotation reach their final size
+        for (size_t i = 0; i < 3; i++) {
+            proc.onRead(msg);
+            REQUIRE(proc.getLast(reader, intensities, stamp, timing));
+        }
+
+        size_t received = 0;
+        size_t unchanged = 0;
+        size_t before = allocation_count;
+        for (size_t i = 0; i < ncycles; i++) {
+            msg.ranges[0] = static_cast<float>(i);
+            proc.onRead(msg);
+            if (proc.getLast(reader, intensities, stamp, timing)) {
+                received++;
+            }
+            // No new data: the reader keeps the latest scan
+            if (!proc.getLast(reader, intensities, stamp, timing)) {
+                unchanged++;
+            }
+        }
+        size_t after = allocation_count;
+
+        CHECK(after - before == 0);
+        CHECK(received == ncycles);
+        CHECK(unchanged == ncycles);
+        REQUIRE(reader.scans.size() == nbeams);
+        CHECK(reader.scans[0] == static_cast<double>(ncycles - 1));
+        CHECK(reader.scans[nbeams - 1] == 1.0);
+        REQUIRE(intensities.size() == nbeams);
+        CHECK(intensities[0] == 100.0);
+    }
+
+    SECTION("Steady-state merge of two transformed scans does not allocate")
+    {
+        const size_t nbeams = 720;
+        const size_t ncycles = 100;
+
+        FakeFrameTransform tc;
+        TestLaserFromRosTopic laser;
+        laser.setup(2, nbeams, &tc);
+
+        yarp::rosmsg::sensor_msgs::LaserScan msg;
+        msg.angle_min = 0;
+        msg.angle_max = 360;
+        msg.range_min = 0.1;
+        msg.range_max = 30;
+        msg.ranges.resize(nbeams, 2.0);
+        msg.intensities.resize(nbeams, 100.0);
+
+        // Warm up: the buffers of the inputs and of the merged scan reach their final size
+        for (size_t i = 0; i < 3; i++) {
+            laser.input(0).onRead(msg);
+            laser.input(1).onRead(msg);
+            REQUIRE(laser.acquireDataFromHW());
+        }
+
+        // The transform lookup, the merge and the reuse of m_transforms
+        size_t lookups = tc.lookups;
+        size_t before = allocation_count;
+        for (size_t i = 0; i < ncycles; i++) {
+            msg.ranges[0] = 1.0f + static_cast<float>(i % 10) * 0.1f;
+            laser.input(0).onRead(msg);
+            laser.input(1).onRead(msg);
+            laser.acquireDataFromHW();
+        }
+        size_t after = allocation_count;
+
+        CHECK(after - before == 0);
+        CHECK(tc.lookups - lookups == 2 * ncycles);
+        REQUIRE(laser.laserData().size() == nbeams);
+        size_t valid = 0;
+        for (size_t i = 0; i < nbeams; i++) {
+            if (!std::isnan(laser.laserData()[i])) {
+                valid++;
+            }
+        }
+        CHECK(valid > nbeams / 2);
+    }
+
+    Network::setLocalMode(false);
+}
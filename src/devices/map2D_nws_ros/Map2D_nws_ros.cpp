@@ -11,6 +11,7 @@
 #include <yarp/os/Node.h>
 #include <yarp/os/Publisher.h>
 #include <yarp/os/Subscriber.h>
+#include <yarp/os/SystemClock.h>
 
 #include <yarp/dev/GenericVocabs.h>
 #include <yarp/dev/IMap2D.h>
@@ -21,11 +22,18 @@
 #include <yarp/rosmsg/TickDuration.h>
 #include <yarp/rosmsg/TickTime.h>
 
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <cstdlib>
+#include <cstring>
+#include <exception>
 #include <fstream>
 #include <limits>
 #include <mutex>
+#include <shared_mutex>
 #include <sstream>
+#include <thread>
 
 using namespace yarp::sig;
 using namespace yarp::dev;
@@ -43,18 +51,60 @@ YARP_LOG_COMPONENT(MAP2D_NWS_ROS, "yarp.device.map2D_nws_ros")
 #define RAD2DEG 180/M_PI
 #define DEG2RAD M_PI/180
 
+/**
+  * mapSubscriber
+  */
+
+void mapSubscriber::init(Map2D_nws_ros* server)
+{
+    std::lock_guard<std::mutex> lock(m_server_mutex);
+    m_server = server;
+}
+
+void mapSubscriber::deinit()
+{
+    std::lock_guard<std::mutex> lock(m_server_mutex);
+    m_server = nullptr;
+}
+
+void mapSubscriber::onRead(yarp::rosmsg::nav_msgs::OccupancyGrid& v)
+{
+    std::lock_guard<std::mutex> lock(m_server_mutex);
+    if (m_server)
+    {
+        m_server->mapReceived(v);
+    }
+}
+
 /**
   * Map2D_nws_ros
   */
 
-Map2D_nws_ros::Map2D_nws_ros()
+Map2D_nws_ros::Map2D_nws_ros() :
+        PeriodicThread(0.5)
 {
     m_enable_publish_map = false;
     m_enable_subscribe_map = false;
     m_node = nullptr;
 }
 
-Map2D_nws_ros::~Map2D_nws_ros() = default;
+Map2D_nws_ros::~Map2D_nws_ros()
+{
+    stopConversionThread();
+}
+
+void Map2D_nws_ros::stopConversionThread()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_received_mutex);
+        m_stop_conversion = true;
+    }
+    m_received_cv.notify_one();
+    if (m_conversion_thread.joinable())
+    {
+        m_conversion_thread.join();
+    }
+}
 
 bool Map2D_nws_ros::read(yarp::os::ConnectionReader& connection)
 {
@@ -67,10 +117,58 @@ bool Map2D_nws_ros::read(yarp::os::ConnectionReader& connection)
 
     reply.clear();
 
-    if (command.get(0).isString() && command.get(0).asString() == "help")
+    std::string cmd = command.get(0).isString() ? command.get(0).asString() : "";
+    if (cmd == "help")
     {
         reply.addVocab32("many");
-        reply.addString("No commands currently available:");
+        reply.addString("Available commands:");
+        reply.addString("publish <map_name>: publishes a map on the ROS topics");
+        reply.addString("subscribe [map_name]: stores again the last map received from ROS, fails if none has been received");
+        reply.addString("list: lists the maps of the attached device");
+        reply.addString("markers: publishes the changes of the locations as markers");
+    }
+    else if (cmd == "publish" || cmd == "subscribe" || cmd == "list" || cmd == "markers")
+    {
+        bool ret = false;
+        if (cmd == "publish")
+        {
+            if (!m_enable_publish_map || command.size() != 2) {
+                yCError(MAP2D_NWS_ROS) << "Usage: publish <map_name>, with the ROS publisher enabled";
+            } else {
+                ret = publishMapToRos(command.get(1).asString());
+            }
+        }
+        else if (cmd == "subscribe")
+        {
+            if (!m_enable_subscribe_map) {
+                yCError(MAP2D_NWS_ROS) << "The ROS subscriber is not enabled";
+            } else {
+                ret = subscribeMapFromRos(command.size() > 1 ? command.get(1).asString() : "ros_map");
+            }
+        }
+        else if (cmd == "markers")
+        {
+            ret = updateVizMarkers();
+        }
+        else
+        {
+            std::vector<std::string> map_names;
+            {
+                std::shared_lock<std::shared_mutex> lock(m_mutex);
+                ret = (m_iMap2D != nullptr) && m_iMap2D->get_map_names(map_names);
+            }
+            if (ret)
+            {
+                reply.addVocab32(VOCAB_OK);
+                Bottle& names = reply.addList();
+                for (const auto& name : map_names) {
+                    names.addString(name);
+                }
+            }
+        }
+        if (cmd != "list" || !ret) {
+            reply.addVocab32(ret ? VOCAB_OK : VOCAB_ERR);
+        }
     }
     else
     {
@@ -129,15 +227,53 @@ bool Map2D_nws_ros::open(yarp::os::Searchable &config)
             yCInfo(MAP2D_NWS_ROS) << "Enabled ROS subscriber";
         }
 
+        m_enable_map_updates = ROS_config.check("enable_map_updates", Value(false)).asBool();
+        m_keyframe_period = ROS_config.check("keyframe_period", Value(30.0)).asFloat64();
+        m_latch_period = ROS_config.check("latch_period", Value(0.5)).asFloat64();
+        m_subscriber_topic = ROS_config.check("subscriber_topic", Value(ROSTOPICNAME_MAP)).asString();
+        std::string encoding = ROS_config.check("map_encoding", Value("raw")).asString();
+        std::string subscriber_encoding = ROS_config.check("subscriber_map_encoding", Value("raw")).asString();
+        if ((encoding != "raw" && encoding != "rle") || (subscriber_encoding != "raw" && subscriber_encoding != "rle"))
+        {
+            yCError(MAP2D_NWS_ROS) << "Invalid map_encoding/subscriber_map_encoding, they must be `raw` or `rle`";
+            return false;
+        }
+        m_publish_rle = (encoding == "rle");
+        int pyramid_levels = ROS_config.check("pyramid_levels", Value(0)).asInt32();
+        if (pyramid_levels < 0 || pyramid_levels > 8)
+        {
+            yCError(MAP2D_NWS_ROS) << "Invalid pyramid_levels" << pyramid_levels << ", it must be between 0 and 8";
+            return false;
+        }
+        m_subscribe_rle = (subscriber_encoding == "rle");
+        std::string name_source = ROS_config.check("subscriber_map_name", Value("topic")).asString();
+        if (name_source != "topic" && name_source != "header")
+        {
+            yCError(MAP2D_NWS_ROS) << "Invalid subscriber_map_name" << name_source << ", it must be `topic` or `header`";
+            return false;
+        }
+        m_map_name_from_header = (name_source == "header");
+
+        m_free_threshold = ROS_config.check("free_threshold", Value(70)).asInt32();
+        m_wall_threshold = ROS_config.check("wall_threshold", Value(71)).asInt32();
+        if (m_free_threshold < 0 || m_wall_threshold > 100 || m_free_threshold >= m_wall_threshold)
+        {
+            yCError(MAP2D_NWS_ROS) << "Invalid free_threshold/wall_threshold, they must satisfy 0 <= free_threshold < wall_threshold <= 100";
+            return false;
+        }
+
+        if ((m_enable_publish_map || m_enable_subscribe_map) && m_node == nullptr)
+        {
+            m_node = new yarp::os::Node(ROSNODENAME);
+        }
+
         if (m_enable_publish_map)
         {
-            if (m_node == nullptr)
-            {
-                m_node = new yarp::os::Node(ROSNODENAME);
-            }
-            if (!m_publisherPort_map.topic(ROSTOPICNAME_MAP))
+            // The encoded maps are published on their own topic, not to confuse the ROS clients of /map
+            std::string map_topic = m_publish_rle ? ROSTOPICNAME_MAPCOMPRESSED : ROSTOPICNAME_MAP;
+            if (!m_publisherPort_map.topic(map_topic))
             {
-                yCError(MAP2D_NWS_ROS) << "Unable to publish to" << ROSTOPICNAME_MAP << "topic, check your YARP-ROS network configuration";
+                yCError(MAP2D_NWS_ROS) << "Unable to publish to" << map_topic << "topic, check your YARP-ROS network configuration";
                 return false;
             }
             if (!m_publisherPort_metamap.topic(ROSTOPICNAME_MAPMETADATA))
@@ -145,27 +281,42 @@ bool Map2D_nws_ros::open(yarp::os::Searchable &config)
                 yCError(MAP2D_NWS_ROS) << "Unable to publish to " << ROSTOPICNAME_MAPMETADATA << " topic, check your YARP-ROS network configuration";
                 return false;
             }
-            //should I publish the map now? with which name ?
-            //publishMapToRos();
-        }
-
-        if (m_enable_subscribe_map)
-        {
-            if (!m_subscriberPort_map.topic(ROSTOPICNAME_MAP))
+            if (m_enable_map_updates && !m_publisherPort_mapUpdates.topic(ROSTOPICNAME_MAPUPDATES))
             {
-                yCError(MAP2D_NWS_ROS) << "Unable to subscribe to " << ROSTOPICNAME_MAP << " topic, check your YARP-ROS network configuration";
+                yCError(MAP2D_NWS_ROS) << "Unable to publish to " << ROSTOPICNAME_MAPUPDATES << " topic, check your YARP-ROS network configuration";
                 return false;
             }
-            if (!m_subscriberPort_metamap.topic(ROSTOPICNAME_MAPMETADATA))
+            for (int level = 1; level <= pyramid_levels; level++)
+            {
+                std::string level_topic = std::string(ROSTOPICNAME_MAP) + "_" + std::to_string(1 << level) + "x";
+                m_publisherPorts_pyramid.push_back(std::make_unique<yarp::os::Publisher<yarp::rosmsg::nav_msgs::OccupancyGrid>>());
+                if (!m_publisherPorts_pyramid.back()->topic(level_topic))
+                {
+                    yCError(MAP2D_NWS_ROS) << "Unable to publish to " << level_topic << " topic, check your YARP-ROS network configuration";
+                    return false;
+                }
+            }
+            m_pyramid_subscribers.assign(m_publisherPorts_pyramid.size(), 0);
+            // The maps are published by the rpc command, this thread only serves the late subscribers
+            if (!setPeriod(m_latch_period) || !start())
             {
-                yCError(MAP2D_NWS_ROS) << "Unable to subscribe to " << ROSTOPICNAME_MAPMETADATA << " topic, check your YARP-ROS network configuration";
+                yCError(MAP2D_NWS_ROS) << "Unable to start the thread serving the late subscribers";
                 return false;
             }
-            m_subscriberPort_map.setStrict();
-            m_subscriberPort_metamap.setStrict();
+        }
 
-            //should I subscribe the map now ? with which name ?
-            //subscribeMapFromRos();
+        if (m_enable_subscribe_map)
+        {
+            // The received maps are converted by a dedicated thread, to keep the callback short
+            m_stop_conversion = false;
+            m_conversion_thread = std::thread(&Map2D_nws_ros::conversionLoop, this);
+            m_subscriberPort_map.init(this);
+            if (!m_subscriberPort_map.topic(m_subscriber_topic))
+            {
+                yCError(MAP2D_NWS_ROS) << "Unable to subscribe to " << m_subscriber_topic << " topic, check your YARP-ROS network configuration";
+                return false;
+            }
+            m_subscriberPort_map.useCallback();
         }
     }
     else
@@ -179,16 +330,25 @@ bool Map2D_nws_ros::open(yarp::os::Searchable &config)
 
 bool Map2D_nws_ros::publishMapToRos(std::string map_name)
 {
+    // Several maps can be read and converted at the same time, only the publication is serialized
     MapGrid2D current_map;
-    if (!m_iMap2D->get_map(map_name, current_map))
     {
-        yCError(MAP2D_NWS_ROS) << "publishMapToRos() " << map_name << " does not exists";
-        return false;
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        if (m_iMap2D == nullptr)
+        {
+            yCError(MAP2D_NWS_ROS) << "publishMapToRos() no device attached";
+            return false;
+        }
+
+        if (!m_iMap2D->get_map(map_name, current_map))
+        {
+            yCError(MAP2D_NWS_ROS) << "publishMapToRos() " << map_name << " does not exists";
+            return false;
+        }
     }
 
     double tmp = 0;
-    yarp::rosmsg::nav_msgs::OccupancyGrid& ogrid = m_publisherPort_map.prepare();
-    ogrid.clear();
+    yarp::rosmsg::nav_msgs::OccupancyGrid ogrid;
     ogrid.info.height = current_map.height();
     ogrid.info.width = current_map.width();
     current_map.getResolution(tmp);
@@ -208,102 +368,681 @@ bool Map2D_nws_ros::publishMapToRos(std::string map_name)
     ogrid.info.origin.orientation.y = q.y();
     ogrid.info.origin.orientation.z = q.z();
     ogrid.info.origin.orientation.w = q.w();
-    ogrid.data.resize(current_map.width() * current_map.height());
-    int index = 0;
-    yarp::dev::Nav2D::XYCell cell;
-    for (cell.y = current_map.height(); cell.y-- > 0;) {
-        for (cell.x = 0; cell.x < current_map.width(); cell.x++)
+    occupancyToRos(current_map, ogrid.data);
+
+    std::lock_guard<std::mutex> lock(m_publish_mutex);
+    if (!m_enable_map_updates || !publishMapUpdates(map_name, ogrid))
+    {
+        // The message is kept, to serve the subscribers connecting later
+        PublishedMap& published = m_published_maps[map_name];
+        published.grid = std::move(ogrid);
+        published.keyframe_time = yarp::os::Time::now();
+        m_last_published_map = map_name;
+        sendMap(map_name, published.grid);
+    }
+
+    if (!m_publisherPorts_pyramid.empty())
+    {
+        publishPyramid(map_name, m_published_maps[map_name].grid);
+    }
+
+    return true;
+}
+
+void Map2D_nws_ros::publishPyramid(const std::string& map_name, const yarp::rosmsg::nav_msgs::OccupancyGrid& grid)
+{
+    // The levels are rebuilt only if the map changed since they were built
+    std::uint64_t hash = hashRosMap(grid);
+    Pyramid& pyramid = m_pyramids[map_name];
+    if (pyramid.levels.size() != m_publisherPorts_pyramid.size() || pyramid.source_hash != hash)
+    {
+        pyramid.levels.resize(m_publisherPorts_pyramid.size());
+        const yarp::rosmsg::nav_msgs::OccupancyGrid* source = &grid;
+        for (auto& level : pyramid.levels)
         {
-            current_map.getOccupancyData(cell, tmp);
-            ogrid.data[index++] = (int)tmp;
+            downsampleRosMap(*source, level);
+            source = &level;
         }
+        pyramid.source_hash = hash;
     }
 
+    for (size_t i = 0; i < pyramid.levels.size(); i++)
+    {
+        m_publisherPorts_pyramid[i]->prepare() = pyramid.levels[i];
+        m_publisherPorts_pyramid[i]->write();
+    }
+}
+
+void Map2D_nws_ros::downsampleRosMap(const yarp::rosmsg::nav_msgs::OccupancyGrid& in, yarp::rosmsg::nav_msgs::OccupancyGrid& out)
+{
+    // The origin is the corner of the first cell, that is the same for the two maps
+    size_t in_width = in.info.width;
+    size_t in_height = in.info.height;
+    size_t width = (in_width + 1) / 2;
+    size_t height = (in_height + 1) / 2;
+    out.header = in.header;
+    out.info = in.info;
+    out.info.width = width;
+    out.info.height = height;
+    out.info.resolution = in.info.resolution * 2;
+    out.data.assign(width * height, -1);
+    if (in.data.size() != in_width * in_height)
+    {
+        return;
+    }
+
+    // Each cell is the maximum of the known cells of its 2x2 block, -1 if they are all unknown
+    for (size_t y = 0; y < in_height; y++)
+    {
+        const std::int8_t* in_row = in.data.data() + y * in_width;
+        std::int8_t* out_row = out.data.data() + (y / 2) * width;
+        for (size_t x = 0; x < in_width; x++)
+        {
+            std::int8_t v = in_row[x];
+            std::int8_t& o = out_row[x / 2];
+            if (v >= 0 && (o < 0 || v > o)) {
+                o = v;
+            }
+        }
+    }
+}
+
+void Map2D_nws_ros::sendMap(const std::string& map_name, const yarp::rosmsg::nav_msgs::OccupancyGrid& grid)
+{
+    yarp::rosmsg::nav_msgs::OccupancyGrid& out = m_publisherPort_map.prepare();
+    if (m_publish_rle)
+    {
+        out.header = grid.header;
+        out.info = grid.info;
+        double start = yarp::os::SystemClock::nowSystem();
+        encodeRle(grid.data, out.data);
+        double elapsed = yarp::os::SystemClock::nowSystem() - start;
+        yCInfo(MAP2D_NWS_ROS) << "Map" << map_name << "encoded from" << grid.data.size() << "to" << out.data.size()
+                              << "bytes, ratio" << static_cast<double>(grid.data.size()) / std::max<size_t>(out.data.size(), 1)
+                              << "in" << elapsed * 1000 << "ms";
+    }
+    else
+    {
+        out = grid;
+    }
     m_publisherPort_map.write();
+    m_publisherPort_metamap.prepare() = grid.info;
+    m_publisherPort_metamap.write();
+}
+
+void Map2D_nws_ros::run()
+{
+    // The subscribers connected after the last publication receive the last map, as with a latched ROS topic.
+    // It is sent to all the subscribers, since a YARP publisher cannot address a single one.
+    std::lock_guard<std::mutex> lock(m_publish_mutex);
+    int subscribers = m_publisherPort_map.asPort().getOutputCount();
+    if (subscribers > m_map_subscribers)
+    {
+        auto it = m_published_maps.find(m_last_published_map);
+        if (it != m_published_maps.end())
+        {
+            sendMap(it->first, it->second.grid);
+        }
+    }
+    m_map_subscribers = subscribers;
 
-    //what about the m_publisherPort_metamap ?
-    //I don't know...
+    auto pyramid = m_pyramids.find(m_last_published_map);
+    for (size_t i = 0; i < m_publisherPorts_pyramid.size(); i++)
+    {
+        int level_subscribers = m_publisherPorts_pyramid[i]->asPort().getOutputCount();
+        if (level_subscribers > m_pyramid_subscribers[i] && pyramid != m_pyramids.end() && i < pyramid->second.levels.size())
+        {
+            m_publisherPorts_pyramid[i]->prepare() = pyramid->second.levels[i];
+            m_publisherPorts_pyramid[i]->write();
+        }
+        m_pyramid_subscribers[i] = level_subscribers;
+    }
+}
+
+bool Map2D_nws_ros::publishMapUpdates(const std::string& map_name, const yarp::rosmsg::nav_msgs::OccupancyGrid& ogrid)
+{
+    // A complete map is needed by the new subscribers, and if the subscribers hold another map
+    int subscribers = m_publisherPort_map.asPort().getOutputCount();
+    bool new_subscribers = subscribers > m_map_subscribers;
+    m_map_subscribers = subscribers;
+    auto it = m_published_maps.find(map_name);
+    if (new_subscribers || map_name != m_last_published_map || it == m_published_maps.end())
+    {
+        return false;
+    }
+
+    PublishedMap& published = it->second;
+    const auto& info = ogrid.info;
+    const auto& published_info = published.grid.info;
+    if (info.width != published_info.width || info.height != published_info.height ||
+        info.resolution != published_info.resolution ||
+        info.origin.position.x != published_info.origin.position.x ||
+        info.origin.position.y != published_info.origin.position.y ||
+        info.origin.orientation.z != published_info.origin.orientation.z ||
+        info.origin.orientation.w != published_info.origin.orientation.w ||
+        yarp::os::Time::now() - published.keyframe_time >= m_keyframe_period)
+    {
+        return false;
+    }
+
+    std::vector<MapPatch> patches = computeDirtyRectangles(published.grid.data, ogrid.data, info.width, info.height);
+    size_t dirty = 0;
+    for (const auto& patch : patches)
+    {
+        dirty += patch.width * patch.height;
+    }
+    if (dirty * 2 > ogrid.data.size())
+    {
+        return false;
+    }
+
+    // The origin of a patch is its bottom left cell, in the frame of the map
+    double yaw = 2 * std::atan2(info.origin.orientation.z, info.origin.orientation.w);
+    double c = std::cos(yaw);
+    double s = std::sin(yaw);
+    for (const auto& patch : patches)
+    {
+        yarp::rosmsg::nav_msgs::OccupancyGrid& update = m_publisherPort_mapUpdates.prepare();
+        update.clear();
+        update.header.frame_id = ogrid.header.frame_id;
+        update.info = info;
+        update.info.width = patch.width;
+        update.info.height = patch.height;
+        double dx = patch.x * info.resolution;
+        double dy = patch.y * info.resolution;
+        update.info.origin.position.x = info.origin.position.x + c * dx - s * dy;
+        update.info.origin.position.y = info.origin.position.y + s * dx + c * dy;
+        update.data.resize(patch.width * patch.height);
+        for (size_t row = 0; row < patch.height; row++)
+        {
+            const std::int8_t* src = ogrid.data.data() + (patch.y + row) * info.width + patch.x;
+            std::memcpy(update.data.data() + row * patch.width, src, patch.width);
+            std::memcpy(published.grid.data.data() + (patch.y + row) * info.width + patch.x, src, patch.width);
+        }
+        m_publisherPort_mapUpdates.write(true);
+    }
 
     return true;
 }
 
-bool Map2D_nws_ros::subscribeMapFromRos(std::string map_name)
+std::vector<Map2D_nws_ros::MapPatch> Map2D_nws_ros::computeDirtyRectangles(const std::vector<std::int8_t>& before,
+                                                                           const std::vector<std::int8_t>& after,
+                                                                           size_t width, size_t height, size_t tile_size)
+{
+    std::vector<MapPatch> patches;
+    if (before.size() != width * height || after.size() != width * height || tile_size == 0)
+    {
+        return patches;
+    }
+
+    size_t tiles_x = (width + tile_size - 1) / tile_size;
+    size_t tiles_y = (height + tile_size - 1) / tile_size;
+
+    // Changed tiles, found comparing the maps one row of cells at a time
+    std::vector<bool> dirty(tiles_x * tiles_y, false);
+    for (size_t y = 0; y < height; y++)
+    {
+        const std::int8_t* b = before.data() + y * width;
+        const std::int8_t* a = after.data() + y * width;
+        if (std::memcmp(a, b, width) == 0) {
+            continue;
+        }
+        size_t ty = y / tile_size;
+        for (size_t tx = 0; tx < tiles_x; tx++)
+        {
+            size_t x0 = tx * tile_size;
+            size_t w = std::min(tile_size, width - x0);
+            if (!dirty[ty * tiles_x + tx] && std::memcmp(a + x0, b + x0, w) != 0) {
+                dirty[ty * tiles_x + tx] = true;
+            }
+        }
+    }
+
+    // Runs of changed tiles in each row of tiles, merged with the run with the same extent in the previous row
+    std::vector<MapPatch> open_runs;
+    for (size_t ty = 0; ty < tiles_y; ty++)
+    {
+        std::vector<MapPatch> runs;
+        for (size_t tx = 0; tx < tiles_x;)
+        {
+            if (!dirty[ty * tiles_x + tx]) {
+                tx++;
+                continue;
+            }
+            size_t first = tx;
+            while (tx < tiles_x && dirty[ty * tiles_x + tx]) {
+                tx++;
+            }
+            MapPatch run;
+            run.x = first * tile_size;
+            run.width = std::min(tx * tile_size, width) - run.x;
+            run.y = ty * tile_size;
+            run.height = std::min(tile_size, height - run.y);
+            auto prev = std::find_if(open_runs.begin(), open_runs.end(), [&run](const MapPatch& p) {
+                return p.x == run.x && p.width == run.width;
+            });
+            if (prev != open_runs.end()) {
+                run.y = prev->y;
+                run.height += prev->height;
+                open_runs.erase(prev);
+            }
+            runs.push_back(run);
+        }
+        // The runs not continued in this row are complete
+        patches.insert(patches.end(), open_runs.begin(), open_runs.end());
+        open_runs = std::move(runs);
+    }
+    patches.insert(patches.end(), open_runs.begin(), open_runs.end());
+
+    return patches;
+}
+
+void Map2D_nws_ros::encodeRle(const std::vector<std::int8_t>& in, std::vector<std::int8_t>& out)
+{
+    out.clear();
+    size_t i = 0;
+    while (i < in.size())
+    {
+        std::int8_t value = in[i];
+        size_t run = 1;
+        while (i + run < in.size() && in[i + run] == value) {
+            run++;
+        }
+        i += run;
+
+        // The value, then the length of the run as unsigned LEB128
+        out.push_back(value);
+        do
+        {
+            auto byte = static_cast<std::uint8_t>(run & 0x7F);
+            run >>= 7;
+            if (run != 0) {
+                byte |= 0x80;
+            }
+            out.push_back(static_cast<std::int8_t>(byte));
+        } while (run != 0);
+    }
+}
+
+bool Map2D_nws_ros::decodeRle(const std::vector<std::int8_t>& in, size_t expected_size, std::vector<std::int8_t>& out)
+{
+    if (expected_size > maxRosMapCells) {
+        return false;
+    }
+
+    // Reads the run starting at in[i], false if it is malformed or exceeds the expected size
+    auto readRun = [&in, expected_size](size_t& i, size_t written, std::int8_t& value, size_t& run) {
+        value = in[i++];
+        run = 0;
+        unsigned int shift = 0;
+        bool more = true;
+        while (more)
+        {
+            if (i >= in.size() || shift >= 8 * sizeof(size_t)) {
+                return false;
+            }
+            auto byte = static_cast<std::uint8_t>(in[i++]);
+            run |= static_cast<size_t>(byte & 0x7F) << shift;
+            shift += 7;
+            more = (byte & 0x80) != 0;
+        }
+        return run != 0 && run <= expected_size - written;
+    };
+
+    // The stream is validated first, so that the output is allocated only if it decodes to expected_size cells
+    std::int8_t value = 0;
+    size_t run = 0;
+    size_t written = 0;
+    for (size_t i = 0; i < in.size(); written += run)
+    {
+        if (!readRun(i, written, value, run)) {
+            return false;
+        }
+    }
+    if (written != expected_size) {
+        return false;
+    }
+
+    out.resize(expected_size);
+    written = 0;
+    for (size_t i = 0; i < in.size(); written += run)
+    {
+        readRun(i, written, value, run);
+        std::memset(out.data() + written, value, run);
+    }
+    return true;
+}
+
+void Map2D_nws_ros::occupancyToRos(const MapGrid2D& map, std::vector<std::int8_t>& data)
 {
-    //In this block receives data from a ROS topic and stores data on attached device
-    //yarp::os::Time::delay(5);
-    yarp::rosmsg::nav_msgs::OccupancyGrid* map_ros = nullptr;
-    yarp::rosmsg::nav_msgs::MapMetaData* metamap_ros = nullptr;
-
-    map_ros = m_subscriberPort_map.read(true);
-    metamap_ros = m_subscriberPort_metamap.read(true);
-    if (map_ros != nullptr && metamap_ros != nullptr)
-    {
-        yCInfo(MAP2D_NWS_ROS) << "Received map for ROS";
-        std::string map_name = "ros_map";
-        MapGrid2D map;
-        map.setSize_in_cells(map_ros->info.width,map_ros->info.height);
-        map.setResolution(map_ros->info.resolution);
-        map.setMapName(map_name);
-        yarp::math::Quaternion quat(map_ros->info.origin.orientation.x,
-                                    map_ros->info.origin.orientation.y,
-                                    map_ros->info.origin.orientation.z,
-                                    map_ros->info.origin.orientation.w);
-        yarp::sig::Matrix mat = quat.toRotationMatrix4x4();
-        yarp::sig::Vector vec = yarp::math::dcm2rpy(mat);
-        double orig_angle = vec[2];
-        map.setOrigin(map_ros->info.origin.position.x,map_ros->info.origin.position.y,orig_angle);
-        for (size_t y = 0; y < map_ros->info.height; y++)
-        {
-            for (size_t x = 0; x < map_ros->info.width; x++)
+    // The occupancy is stored one byte per cell, 0-100 or 255 for the unknown cells, that is -1 as int8.
+    // Hence the rows are copied as they are, in reverse order since the y axes are opposite.
+    ImageOf<PixelMono> occupancy;
+    map.getOccupancyGrid(occupancy);
+    size_t width = occupancy.width();
+    size_t height = occupancy.height();
+    data.resize(width * height);
+    for (size_t y = 0; y < height; y++)
+    {
+        std::memcpy(data.data() + (height - 1 - y) * width, occupancy.getRow(y), width);
+    }
+}
+
+bool Map2D_nws_ros::occupancyFromRos(const std::vector<std::int8_t>& data, size_t width, size_t height,
+                                     int free_threshold, int wall_threshold, MapGrid2D& map)
+{
+    if (data.size() != width * height || map.width() != width || map.height() != height)
+    {
+        return false;
+    }
+
+    // The flags can be written in bulk only through the image of the map, hence the colors used by
+    // MapGrid2D for the free, wall and unknown cells are taken from MapGrid2D itself.
+    static const std::array<PixelRgb, 3> flagColors = []() {
+        MapGrid2D sample;
+        sample.setSize_in_cells(3, 1);
+        sample.setMapFlag(XYCell(0, 0), MapGrid2D::MAP_CELL_FREE);
+        sample.setMapFlag(XYCell(1, 0), MapGrid2D::MAP_CELL_WALL);
+        sample.setMapFlag(XYCell(2, 0), MapGrid2D::MAP_CELL_UNKNOWN);
+        ImageOf<PixelRgb> image;
+        sample.getMapImage(image);
+        return std::array<PixelRgb, 3>{ image.pixel(0, 0), image.pixel(1, 0), image.pixel(2, 0) };
+    }();
+
+    // One entry for each int8 value, indexed by the value as uint8
+    struct Conversion
+    {
+        PixelMono occupancy;
+        PixelRgb  color;
+    };
+    std::array<Conversion, 256> lut;
+    for (int v = -128; v < 128; v++)
+    {
+        Conversion& c = lut[static_cast<std::uint8_t>(v)];
+        c.occupancy = (v < 0) ? 255 : static_cast<PixelMono>(v);
+        if (v >= 0 && v <= free_threshold) {
+            c.color = flagColors[0];
+        } else if (v >= wall_threshold && v <= 100) {
+            c.color = flagColors[1];
+        } else {
+            c.color = flagColors[2];
+        }
+    }
+
+    ImageOf<PixelMono> occupancy;
+    ImageOf<PixelRgb> flags;
+    occupancy.resize(width, height);
+    flags.resize(width, height);
+
+    // The first row of the ROS map is the last one of the YARP map
+    auto convertRows = [&](size_t first, size_t last) {
+        for (size_t y = first; y < last; y++)
+        {
+            const std::int8_t* in = data.data() + (height - 1 - y) * width;
+            PixelMono* occ = occupancy.getRow(y);
+            auto* col = reinterpret_cast<PixelRgb*>(flags.getRow(y));
+            for (size_t x = 0; x < width; x++)
             {
-                XYCell cell(x,map_ros->info.height - 1 - y);
-                double occ = map_ros->data[x + y * map_ros->info.width];
-                map.setOccupancyData(cell,occ);
-
-                if (occ >= 0 && occ <= 70) {
-                    map.setMapFlag(cell, MapGrid2D::MAP_CELL_FREE);
-                } else if (occ >= 71 && occ <= 100) {
-                    map.setMapFlag(cell, MapGrid2D::MAP_CELL_WALL);
-                } else {
-                    map.setMapFlag(cell, MapGrid2D::MAP_CELL_UNKNOWN);
-                }
+                const Conversion& c = lut[static_cast<std::uint8_t>(in[x])];
+                occ[x] = c.occupancy;
+                col[x] = c.color;
             }
         }
-        if (m_iMap2D->store_map(map))
+    };
+
+    constexpr size_t parallelThreshold = 1000000; // cells
+    size_t threads = 1;
+    if (width * height >= parallelThreshold)
+    {
+        threads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), height);
+    }
+    if (threads == 1)
+    {
+        convertRows(0, height);
+    }
+    else
+    {
+        std::vector<std::thread> workers;
+        size_t rowsPerThread = (height + threads - 1) / threads;
+        for (size_t first = 0; first < height; first += rowsPerThread)
+        {
+            workers.emplace_back(convertRows, first, std::min(first + rowsPerThread, height));
+        }
+        for (auto& w : workers)
+        {
+            w.join();
+        }
+    }
+
+    return map.setOccupancyGrid(occupancy) && map.setMapImage(flags);
+}
+
+bool Map2D_nws_ros::subscribeMapFromRos(std::string map_name)
+{
+    yarp::rosmsg::nav_msgs::OccupancyGrid map_ros;
+    {
+        std::lock_guard<std::mutex> lock(m_received_mutex);
+        if (!m_has_received_map)
+        {
+            yCError(MAP2D_NWS_ROS) << "subscribeMapFromRos() no map received yet from" << m_subscriber_topic;
+            return false;
+        }
+        map_ros = m_last_received_map;
+    }
+    return storeRosMap(map_ros, map_name);
+}
+
+void Map2D_nws_ros::mapReceived(yarp::rosmsg::nav_msgs::OccupancyGrid& map)
+{
+    // A map not yet converted is replaced by the new one
+    {
+        std::lock_guard<std::mutex> lock(m_received_mutex);
+        m_pending_map = std::move(map);
+        m_has_pending_map = true;
+    }
+    m_received_cv.notify_one();
+}
+
+void Map2D_nws_ros::conversionLoop()
+{
+    while (true)
+    {
+        // Only the exchange of the message is done under the lock, the subscriber callback is never
+        // blocked by the hash or by the conversion of a large map
+        yarp::rosmsg::nav_msgs::OccupancyGrid received;
+        {
+            std::unique_lock<std::mutex> lock(m_received_mutex);
+            m_received_cv.wait(lock, [this]() { return m_stop_conversion || m_has_pending_map; });
+            if (m_stop_conversion) {
+                return;
+            }
+            std::swap(received, m_pending_map);
+            m_has_pending_map = false;
+        }
+
+        size_t first = m_subscriber_topic.find_first_not_of('/');
+        std::string map_name = (first == std::string::npos) ? "ros_map" : m_subscriber_topic.substr(first);
+        if (m_map_name_from_header && !received.header.frame_id.empty()) {
+            map_name = received.header.frame_id;
+        }
+        std::uint64_t hash = hashRosMap(received);
+
+        // m_last_received_map is modified only by this thread, under the lock since the rpc thread reads it.
+        // m_stored_hashes is cleared by attach() and detach().
+        bool unchanged = false;
+        {
+            std::lock_guard<std::mutex> lock(m_received_mutex);
+            std::swap(m_last_received_map, received);
+            m_has_received_map = true;
+            auto it = m_stored_hashes.find(map_name);
+            unchanged = (it != m_stored_hashes.end() && it->second == hash);
+        }
+
+        // The map may have been deleted through the device meanwhile
+        if (unchanged && isMapStored(map_name))
+        {
+            yCDebug(MAP2D_NWS_ROS) << "Received map" << map_name << "is unchanged, not converted";
+            continue;
+        }
+
+        // A map that cannot be converted must not terminate the thread, hence the whole process.
+        bool stored = false;
+        try
+        {
+            stored = storeRosMap(m_last_received_map, map_name);
+        }
+        catch (const std::exception& e)
+        {
+            yCError(MAP2D_NWS_ROS) << "Unable to convert the received map" << map_name << ":" << e.what();
+        }
+        if (stored) {
+            std::lock_guard<std::mutex> lock(m_received_mutex);
+            m_stored_hashes[map_name] = hash;
+        }
+    }
+}
+
+bool Map2D_nws_ros::isMapStored(const std::string& map_name)
+{
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    std::vector<std::string> names;
+    if (m_iMap2D == nullptr || !m_iMap2D->get_map_names(names))
+    {
+        return false;
+    }
+    return std::find(names.begin(), names.end(), map_name) != names.end();
+}
+
+std::uint64_t Map2D_nws_ros::hashRosMap(const yarp::rosmsg::nav_msgs::OccupancyGrid& map)
+{
+    std::uint64_t hash = 14695981039346656037ULL;
+    auto add = [&hash](const void* bytes, size_t size) {
+        const auto* b = static_cast<const unsigned char*>(bytes);
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ b[i]) * 1099511628211ULL;
+        }
+    };
+    const auto& info = map.info;
+    std::uint32_t width = info.width;
+    std::uint32_t height = info.height;
+    float resolution = info.resolution;
+    double origin[] = { info.origin.position.x, info.origin.position.y,
+                        info.origin.orientation.x, info.origin.orientation.y,
+                        info.origin.orientation.z, info.origin.orientation.w };
+    add(&width, sizeof(width));
+    add(&height, sizeof(height));
+    add(&resolution, sizeof(resolution));
+    add(origin, sizeof(origin));
+    add(map.data.data(), map.data.size());
+    return hash;
+}
+
+bool Map2D_nws_ros::storeRosMap(const yarp::rosmsg::nav_msgs::OccupancyGrid& map_ros, const std::string& map_name)
+{
+    // The size of the map comes from the message, it is checked before allocating anything
+    size_t cells = static_cast<size_t>(map_ros.info.width) * map_ros.info.height;
+    if (cells == 0 || cells > maxRosMapCells)
+    {
+        yCError(MAP2D_NWS_ROS) << "Received map" << map_name << "has an invalid size" << map_ros.info.width << "x" << map_ros.info.height;
+        return false;
+    }
+    if (!m_subscribe_rle && map_ros.data.size() != cells)
+    {
+        yCError(MAP2D_NWS_ROS) << "Received map has" << map_ros.data.size() << "cells, expected" << map_ros.info.width << "x" << map_ros.info.height;
+        return false;
+    }
+
+    const std::vector<std::int8_t>* data = &map_ros.data;
+    std::vector<std::int8_t> decoded;
+    if (m_subscribe_rle)
+    {
+        double start = yarp::os::SystemClock::nowSystem();
+        if (!decodeRle(map_ros.data, cells, decoded))
         {
-            yCInfo(MAP2D_NWS_ROS) << "Added map " << map.getMapName() << " to storage";
-            return true;
+            yCError(MAP2D_NWS_ROS) << "Received map" << map_name << "is not a valid RLE encoded map";
+            return false;
         }
+        double elapsed = yarp::os::SystemClock::nowSystem() - start;
+        yCInfo(MAP2D_NWS_ROS) << "Map" << map_name << "decoded from" << map_ros.data.size() << "to" << decoded.size()
+                              << "bytes, ratio" << static_cast<double>(decoded.size()) / std::max<size_t>(map_ros.data.size(), 1)
+                              << "in" << elapsed * 1000 << "ms";
+        data = &decoded;
+    }
 
-        yCInfo(MAP2D_NWS_ROS) << "Unable to add map " << map.getMapName() << " to storage";
+    MapGrid2D map;
+    map.setSize_in_cells(map_ros.info.width, map_ros.info.height);
+    map.setResolution(map_ros.info.resolution);
+    map.setMapName(map_name);
+    yarp::math::Quaternion quat(map_ros.info.origin.orientation.x,
+                                map_ros.info.origin.orientation.y,
+                                map_ros.info.origin.orientation.z,
+                                map_ros.info.origin.orientation.w);
+    yarp::sig::Matrix mat = quat.toRotationMatrix4x4();
+    yarp::sig::Vector vec = yarp::math::dcm2rpy(mat);
+    double orig_angle = vec[2];
+    map.setOrigin(map_ros.info.origin.position.x, map_ros.info.origin.position.y, orig_angle);
+    if (!occupancyFromRos(*data, map_ros.info.width, map_ros.info.height, m_free_threshold, m_wall_threshold, map))
+    {
+        yCError(MAP2D_NWS_ROS) << "Received map has" << data->size() << "cells, expected" << map_ros.info.width << "x" << map_ros.info.height;
         return false;
     }
 
+    // The map is converted without locks, the attached device is accessed exclusively only to store it
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    if (m_iMap2D == nullptr)
+    {
+        yCError(MAP2D_NWS_ROS) << "Received map" << map_name << "not stored, no device attached";
+        return false;
+    }
+    if (m_iMap2D->store_map(map))
+    {
+        yCInfo(MAP2D_NWS_ROS) << "Added map " << map.getMapName() << " to storage";
+        return true;
+    }
+
+    yCInfo(MAP2D_NWS_ROS) << "Unable to add map " << map.getMapName() << " to storage";
     return false;
 }
 
 bool Map2D_nws_ros::close()
 {
     yCTrace(MAP2D_NWS_ROS, "Close");
+    if (isRunning())
+    {
+        stop();
+    }
     if (m_enable_publish_map)
     {
         m_publisherPort_map.interrupt();
         m_publisherPort_metamap.interrupt();
         m_publisherPort_map.close();
         m_publisherPort_metamap.close();
+        if (m_enable_map_updates)
+        {
+            m_publisherPort_mapUpdates.interrupt();
+            m_publisherPort_mapUpdates.close();
+        }
+        for (auto& port : m_publisherPorts_pyramid)
+        {
+            port->interrupt();
+            port->close();
+        }
+        m_publisherPorts_pyramid.clear();
     }
     if (m_enable_subscribe_map)
     {
+        // The callback is stopped before the server is detached from the subscriber
         m_subscriberPort_map.interrupt();
-        m_subscriberPort_metamap.interrupt();
         m_subscriberPort_map.close();
-        m_subscriberPort_metamap.close();
+        m_subscriberPort_map.deinit();
+        stopConversionThread();
     }
     return true;
 }
 
 bool Map2D_nws_ros::updateVizMarkers(std::string map_name)
 {
+    std::lock_guard<std::mutex> markers_lock(m_markers_mutex);
     if (m_publisherPort_markers.asPort().isOpen()==false)
     {
         m_publisherPort_markers.topic("/locationServerMarkers");
@@ -323,68 +1062,147 @@ bool Map2D_nws_ros::updateVizMarkers(std::string map_name)
         sec_part = 0;
     }
 
+    yarp::rosmsg::TickTime tt;
+    tt.sec  = (yarp::os::NetUint32) sec_part;
+    tt.nsec = (yarp::os::NetUint32) nsec_part;
+
+    // Names and locations are read with two calls, instead of one call per location
+    std::vector<std::string> names;
+    std::vector<Map2DLocation> locations;
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        if (m_iMap2D == nullptr)
+        {
+            yCError(MAP2D_NWS_ROS) << "updateVizMarkers() no device attached";
+            return false;
+        }
+        if (!m_iMap2D->getLocationsList(names) || !m_iMap2D->getAllLocations(locations) || names.size() != locations.size())
+        {
+            // The locations changed between the two calls, or the device cannot list them all at once
+            locations.resize(names.size());
+            for (size_t i = 0; i < names.size(); i++)
+            {
+                m_iMap2D->getLocation(names[i], locations[i]);
+            }
+        }
+    }
+
+    // All the markers are sent again to the new subscribers
+    int subscribers = m_publisherPort_markers.asPort().getOutputCount();
+    bool send_all = subscribers > m_marker_subscribers;
+    m_marker_subscribers = subscribers;
+
     yarp::rosmsg::visualization_msgs::Marker marker;
-    yarp::rosmsg::TickTime    tt;
-    yarp::sig::Vector         rpy(3);
-    yarp::math::Quaternion    q;
+    marker.header.frame_id    = "map";
+    marker.header.stamp       = tt;
+    marker.ns                 = "my_namespace";
+    marker.type               = yarp::rosmsg::visualization_msgs::Marker::ARROW;
+    marker.pose.position.z    = 0;
+    marker.scale.x            = 1;
+    marker.scale.y            = 0.1;
+    marker.scale.z            = 0.1;
+    marker.color.a            = 1.0;
+    marker.color.r            = 0.0;
+    marker.color.g            = 1.0;
+    marker.color.b            = 0.0;
+    marker.lifetime           = dur;
 
     yarp::rosmsg::visualization_msgs::MarkerArray& markers = m_publisherPort_markers.prepare();
     markers.markers.clear();
+    diffMarkers(names, locations, send_all, marker, m_marker_cache, m_next_marker_id, markers);
+
+    if (markers.markers.empty())
+    {
+        m_publisherPort_markers.unprepare();
+        return true;
+    }
 
-    std::vector<std::string> locations;
-    int count = 1;
-    m_iMap2D->getLocationsList(locations);
-    for (auto it : locations)
-    {
-        yarp::dev::Nav2D::Map2DLocation loc;
-        m_iMap2D->getLocation(it, loc);
-        rpy[0] = 0; //x
-        rpy[1] = 0; //y
-        rpy[2] = loc.theta / 180 * 3.14159265359; //z
-        yarp::sig::Matrix m = yarp::math::rpy2dcm(rpy);
-        q.fromRotationMatrix(m);
-
-        marker.header.frame_id    = "map";
-        tt.sec                    = (yarp::os::NetUint32) sec_part;;
-        tt.nsec                   = (yarp::os::NetUint32) nsec_part;;
-        marker.header.stamp       = tt;
-        marker.ns                 = "my_namespace";
-        marker.id                 = count;
-        marker.type               = yarp::rosmsg::visualization_msgs::Marker::ARROW;
+    m_publisherPort_markers.write();
+    return true;
+}
+
+void Map2D_nws_ros::diffMarkers(const std::vector<std::string>& names,
+                                const std::vector<Map2DLocation>& locations,
+                                bool send_all,
+                                const yarp::rosmsg::visualization_msgs::Marker& prototype,
+                                std::map<std::string, MarkerLocation>& cache,
+                                std::int32_t& next_id,
+                                yarp::rosmsg::visualization_msgs::MarkerArray& markers)
+{
+    yarp::rosmsg::visualization_msgs::Marker marker = prototype;
+
+    // Added and modified locations
+    std::map<std::string, MarkerLocation> current;
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        const Map2DLocation& loc = locations[i];
+        auto cached = cache.find(names[i]);
+        MarkerLocation& entry = current[names[i]];
+        entry.location = loc;
+        if (cached != cache.end())
+        {
+            entry.id = cached->second.id;
+            if (!send_all && cached->second.location == loc) {
+                continue;
+            }
+        }
+        else
+        {
+            entry.id = next_id++;
+        }
+
+        marker.id                 = entry.id;
         marker.action             = yarp::rosmsg::visualization_msgs::Marker::ADD;
         marker.pose.position.x    = loc.x;
         marker.pose.position.y    = loc.y;
-        marker.pose.position.z    = 0;
-        marker.pose.orientation.x = q.x();
-        marker.pose.orientation.y = q.y();
-        marker.pose.orientation.z = q.z();
-        marker.pose.orientation.w = q.w();
-        marker.scale.x            = 1;
-        marker.scale.y            = 0.1;
-        marker.scale.z            = 0.1;
-        marker.color.a            = 1.0;
-        marker.color.r            = 0.0;
-        marker.color.g            = 1.0;
-        marker.color.b            = 0.0;
-        marker.lifetime           = dur;
-        marker.text               = it;
+        yawToQuaternion(loc.theta * DEG2RAD, marker.pose.orientation);
+        marker.text               = names[i];
         markers.markers.push_back(marker);
-        count++;
     }
 
-    m_publisherPort_markers.write();
-    return true;
+    // Removed locations
+    for (const auto& cached : cache)
+    {
+        if (current.find(cached.first) == current.end())
+        {
+            marker.id     = cached.second.id;
+            marker.action = yarp::rosmsg::visualization_msgs::Marker::DELETE;
+            marker.text   = cached.first;
+            markers.markers.push_back(marker);
+        }
+    }
+    cache = std::move(current);
+}
+
+void Map2D_nws_ros::yawToQuaternion(double yaw, yarp::rosmsg::geometry_msgs::Quaternion& q)
+{
+    // Rotation around the z axis
+    q.x = 0;
+    q.y = 0;
+    q.z = std::sin(yaw / 2);
+    q.w = std::cos(yaw / 2);
 }
 
 
 bool Map2D_nws_ros::detach()
 {
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
     m_iMap2D = nullptr;
+    clearStoredHashes();
     return true;
 }
 
+void Map2D_nws_ros::clearStoredHashes()
+{
+    // The received maps are stored again in the next attached device
+    std::lock_guard<std::mutex> lock(m_received_mutex);
+    m_stored_hashes.clear();
+}
+
 bool Map2D_nws_ros::attach(PolyDriver* driver)
 {
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    clearStoredHashes();
     if (driver->isValid())
     {
         driver->view(m_iMap2D);
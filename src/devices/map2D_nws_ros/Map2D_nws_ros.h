@@ -6,11 +6,17 @@
 #ifndef YARP_DEV_MAP2D_NWS_ROS_H
 #define YARP_DEV_MAP2D_NWS_ROS_H
 
+#include <cstdint>
+#include <map>
 #include <vector>
 #include <iostream>
 #include <string>
 #include <sstream>
 #include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <memory>
+#include <thread>
 
 #include <yarp/os/Network.h>
 #include <yarp/os/Port.h>
@@ -40,6 +46,22 @@
 #include <yarp/rosmsg/nav_msgs/MapMetaData.h>
 #include <yarp/rosmsg/nav_msgs/OccupancyGrid.h>
 
+class Map2D_nws_ros;
+
+class mapSubscriber :
+    public yarp::os::Subscriber<yarp::rosmsg::nav_msgs::OccupancyGrid>
+{
+public:
+    void init(Map2D_nws_ros* server);
+    void deinit();
+
+    std::mutex     m_server_mutex;
+    Map2D_nws_ros* m_server = nullptr;
+
+    using yarp::os::Subscriber<yarp::rosmsg::nav_msgs::OccupancyGrid>::onRead;
+    void onRead(yarp::rosmsg::nav_msgs::OccupancyGrid& v) override;
+};
+
 /**
  *  @ingroup dev_impl_nws_ros dev_impl_navigation
  *
@@ -53,12 +75,52 @@
  * | name           |      -                 | string  | -              | /map2D_nws_ros/rpc   | No       | Full name of the rpc port opened by the Map2DServer device.       |       |
  * | ROS            | enable_publisher       | bool    | -              | false            | No           | Publishes maps stored in a map2DStorage on a ROS topic            |       |
  * | ROS            | enable_subscriber      | bool    | -              | false            | No           | Receives maps from a ROS topic and stores them in a map2DStorage  |       |
+ * | ROS            | enable_map_updates     | bool    | -              | false            | No           | Publishes only the changed parts of a map already published, on the /map_updates topic | see below |
+ * | ROS            | latch_period           | double  | s              | 0.5              | No           | Period of the check for new subscribers of /map, which receive the last published map |       |
+ * | ROS            | keyframe_period        | double  | s              | 30.0             | No           | Maximum time between two complete publications of the same map    |       |
+ * | ROS            | subscriber_topic       | string  | -              | /map             | No           | Topic from which the maps are received                            |       |
+ * | ROS            | subscriber_map_name    | string  | -              | topic            | No           | Name of the stored maps: `topic` for the topic name without the leading '/', `header` for the frame_id of the message | see below |
+ * | ROS            | map_encoding           | string  | -              | raw              | No           | `raw`, or `rle` to publish the maps run-length encoded on /map_compressed instead of /map | see below |
+ * | ROS            | subscriber_map_encoding | string | -              | raw              | No           | `raw`, or `rle` if the received maps are run-length encoded       |       |
+ * | ROS            | pyramid_levels         | int     | -              | 0                | No           | Number of coarser copies of the published maps, on /map_2x, /map_4x, /map_8x, ... | see below |
+ * | ROS            | free_threshold         | int     | -              | 70               | No           | Received cells with occupancy from 0 to this value are free       |       |
+ * | ROS            | wall_threshold         | int     | -              | 71               | No           | Received cells with occupancy from this value to 100 are walls    | Must be greater than free_threshold, the cells in between are unknown |
 
  * \section Notes:
  * Integration with ROS map server is currently under development.
+ *
+ * The rpc port accepts the commands `publish <map_name>` (publishes a map of the attached device on /map
+ * and /map_metadata), `subscribe [map_name]` (stores the last map already received from ROS in the attached
+ * device, with the given name, "ros_map" by default; it fails if no map has been received yet) and `list`
+ * (the names of the maps of the attached device).
+ * The maps received from ROS are converted by a background thread and stored in the attached device
+ * as they arrive, named after the subscribed topic or after the frame_id of the message (the topic name is
+ * used if the frame_id is empty). If a map arrives while the previous one is being converted, only the most
+ * recent one is converted. A map identical to the last one stored with the same name is not converted again.
+ * The `markers` command publishes the locations of the attached device as markers on /locationServerMarkers:
+ * only the locations added, modified or removed (DELETE action) since the previous call are sent, except
+ * when new subscribers have connected.
+ * The last published map is kept as a ROS message, and is sent again, without converting the map, when new
+ * subscribers connect to /map, as a latched ROS topic would do.
+ * With `map_encoding` rle, the data of the complete maps is run-length encoded (see encodeRle()) and they are
+ * published on /map_compressed, as nav_msgs/OccupancyGrid messages whose data is the encoded occupancy.
+ * Another map2D_nws_ros subscribed to that topic with `subscriber_map_encoding` rle decodes them.
+ * The compression ratio and the encoding and decoding times are logged.
+ * With `pyramid_levels` greater than 0, each published map is also published at 2, 4, 8... times its resolution
+ * (see downsampleRosMap()), with the same origin. The levels are built from the map as last sent to the
+ * subscribers, cached, and rebuilt only when the map changes.
+ * Publications, marker updates and map listings read the attached device concurrently, while storing a
+ * received map, attach and detach take exclusive access to it.
+ *
+ * If `enable_map_updates` is true, a map published again with the same name and geometry is compared with
+ * the previous publication, and only the rectangles containing changed cells are published on /map_updates,
+ * as nav_msgs/OccupancyGrid messages whose origin is the bottom left corner of the rectangle
+ * (the equivalent of map_msgs/OccupancyGridUpdate). The complete map is published on /map when a new
+ * subscriber connects, when `keyframe_period` has elapsed, or when the changes cover more than half of the map.
  */
 
 class Map2D_nws_ros :
+        public yarp::os::PeriodicThread,
         public yarp::dev::DeviceDriver,
         public yarp::os::PortReader,
         public yarp::dev::WrapperSingle
@@ -70,34 +132,187 @@ public:
     bool close() override;
     bool detach() override;
     bool attach(yarp::dev::PolyDriver* driver) override;
+    void run() override;
+
+    /**
+     * Converts the occupancy of a map to the data of a ROS OccupancyGrid (row major, first row at the
+     * bottom of the map). Unknown cells become -1.
+     */
+    static void occupancyToRos(const yarp::dev::Nav2D::MapGrid2D& map, std::vector<std::int8_t>& data);
+
+    /**
+     * A rectangle of cells of a ROS map (x to the right, y up from the first row)
+     */
+    struct MapPatch
+    {
+        size_t x = 0;
+        size_t y = 0;
+        size_t width = 0;
+        size_t height = 0;
+    };
+
+    /**
+     * Finds the rectangles containing the cells that differ between two versions of a ROS map.
+     * The map is divided in tiles of tile_size x tile_size cells, the changed tiles are merged
+     * in rows and then the rows with the same horizontal extent are merged vertically.
+     */
+    static std::vector<MapPatch> computeDirtyRectangles(const std::vector<std::int8_t>& before,
+                                                        const std::vector<std::int8_t>& after,
+                                                        size_t width, size_t height, size_t tile_size = 64);
+
+    /**
+     * Sets the occupancy and the flags of a map, already resized to width x height, from the data of a
+     * ROS OccupancyGrid. Cells with occupancy in [0, free_threshold] are free, in [wall_threshold, 100]
+     * are walls, the others are unknown. Large maps are converted by several threads, one block of rows each.
+     */
+    static bool occupancyFromRos(const std::vector<std::int8_t>& data, size_t width, size_t height,
+                                 int free_threshold, int wall_threshold, yarp::dev::Nav2D::MapGrid2D& map);
+
+    /**
+     * Halves the resolution of a ROS map: each cell is the maximum of the known cells of the corresponding
+     * 2x2 block (-1 if they are all unknown). The origin does not change.
+     */
+    static void downsampleRosMap(const yarp::rosmsg::nav_msgs::OccupancyGrid& in, yarp::rosmsg::nav_msgs::OccupancyGrid& out);
+
+    /**
+     * Run-length encoding of the occupancy of a ROS map: each run of equal cells becomes its value,
+     * followed by its length as unsigned LEB128 (7 bits per byte, least significant first).
+     */
+    static void encodeRle(const std::vector<std::int8_t>& in, std::vector<std::int8_t>& out);
+
+    /**
+     * Largest received map that is converted, 16384 x 16384 cells. The size of the received maps is not
+     * trusted, larger maps are rejected before allocating them.
+     */
+    static constexpr size_t maxRosMapCells = 16384 * 16384;
+
+    /**
+     * Decodes the output of encodeRle(). The data is validated before allocating the output.
+     * @return false if the data is malformed, if it does not decode to exactly expected_size cells,
+     * or if expected_size is greater than maxRosMapCells
+     */
+    static bool decodeRle(const std::vector<std::int8_t>& in, size_t expected_size, std::vector<std::int8_t>& out);
+
+    /**
+     * 64 bit FNV-1a hash of the geometry and of the occupancy of a ROS map.
+     */
+    static std::uint64_t hashRosMap(const yarp::rosmsg::nav_msgs::OccupancyGrid& map);
+
+    /**
+     * Closed form quaternion of a rotation of yaw radians around the z axis.
+     */
+    static void yawToQuaternion(double yaw, yarp::rosmsg::geometry_msgs::Quaternion& q);
+
+    // A location shown by the published markers, with the id of its marker
+    struct MarkerLocation
+    {
+        std::int32_t                       id = 0;
+        yarp::dev::Nav2D::Map2DLocation    location;
+    };
+
+    /**
+     * Appends to markers the changes between the locations shown by the markers in cache and the current ones:
+     * an ADD for each new or modified location, with a new id for the new ones, and a DELETE for each removed
+     * location. With send_all, all the current locations are added. The cache is then updated.
+     * The other fields of the markers are copied from prototype.
+     */
+    static void diffMarkers(const std::vector<std::string>& names,
+                            const std::vector<yarp::dev::Nav2D::Map2DLocation>& locations,
+                            bool send_all,
+                            const yarp::rosmsg::visualization_msgs::Marker& prototype,
+                            std::map<std::string, MarkerLocation>& cache,
+                            std::int32_t& next_id,
+                            yarp::rosmsg::visualization_msgs::MarkerArray& markers);
+
+    /**
+     * Called by the subscriber for each received map: keeps it for the conversion thread and returns.
+     */
+    void mapReceived(yarp::rosmsg::nav_msgs::OccupancyGrid& map);
 
 private:
     //drivers and interfaces
     yarp::dev::Nav2D::IMap2D*    m_iMap2D = nullptr;
     yarp::dev::PolyDriver        m_drv;
 
-    std::mutex                   m_mutex;
+    std::shared_mutex            m_mutex;          // the attached device: shared to read it, exclusive to attach, detach and store maps
+    std::mutex                   m_publish_mutex;  // the publishers of the maps and m_published_maps
+    std::mutex                   m_markers_mutex;  // the publisher of the markers and m_marker_cache
     std::string                  m_rpcPortName;
     yarp::os::Node*              m_node = nullptr;
     bool                         m_enable_publish_map;
     bool                         m_enable_subscribe_map;
+    int                          m_free_threshold = 70;
+    int                          m_wall_threshold = 71;
+    double                       m_latch_period = 0.5;
+    bool                         m_enable_map_updates = false;
+    double                       m_keyframe_period = 30.0;
+    bool                         m_publish_rle = false;
+    bool                         m_subscribe_rle = false;
+
+    // The last version of each map sent on /map or /map_updates
+    struct PublishedMap
+    {
+        yarp::rosmsg::nav_msgs::OccupancyGrid grid;
+        double                                keyframe_time = 0;
+    };
+    std::map<std::string, PublishedMap> m_published_maps;
+    std::string                         m_last_published_map;
+    int                                 m_map_subscribers = 0;
+
+    // The coarser levels of each published map, and the hash of the map they were built from
+    struct Pyramid
+    {
+        std::uint64_t                                      source_hash = 0;
+        std::vector<yarp::rosmsg::nav_msgs::OccupancyGrid> levels;
+    };
+    std::map<std::string, Pyramid> m_pyramids;
+    std::vector<int>               m_pyramid_subscribers;
 
     #define ROSNODENAME "/map2DServerNode"
     #define ROSTOPICNAME_MAP "/map"
     #define ROSTOPICNAME_MAPMETADATA "/map_metadata"
+    #define ROSTOPICNAME_MAPUPDATES "/map_updates"
+    #define ROSTOPICNAME_MAPCOMPRESSED "/map_compressed"
 
     yarp::os::RpcServer                                                    m_rpcPort;
     yarp::os::Publisher<yarp::rosmsg::nav_msgs::OccupancyGrid>             m_publisherPort_map;
     yarp::os::Publisher<yarp::rosmsg::nav_msgs::MapMetaData>               m_publisherPort_metamap;
-    yarp::os::Subscriber<yarp::rosmsg::nav_msgs::OccupancyGrid>            m_subscriberPort_map;
-    yarp::os::Subscriber<yarp::rosmsg::nav_msgs::MapMetaData>              m_subscriberPort_metamap;
+    yarp::os::Publisher<yarp::rosmsg::nav_msgs::OccupancyGrid>             m_publisherPort_mapUpdates;
+    std::vector<std::unique_ptr<yarp::os::Publisher<yarp::rosmsg::nav_msgs::OccupancyGrid>>> m_publisherPorts_pyramid;
+    mapSubscriber                                                          m_subscriberPort_map;
     yarp::os::Publisher<yarp::rosmsg::visualization_msgs::MarkerArray>     m_publisherPort_markers;
 
+    // The locations shown by the last published markers, by name
+    std::map<std::string, MarkerLocation> m_marker_cache;
+    std::int32_t                          m_next_marker_id = 1;
+    int                                   m_marker_subscribers = 0;
+
+    // Received maps, converted by m_conversion_thread
+    std::string                           m_subscriber_topic = ROSTOPICNAME_MAP;
+    bool                                  m_map_name_from_header = false;
+    std::mutex                            m_received_mutex;
+    std::condition_variable               m_received_cv;
+    yarp::rosmsg::nav_msgs::OccupancyGrid m_pending_map;
+    bool                                  m_has_pending_map = false;
+    yarp::rosmsg::nav_msgs::OccupancyGrid m_last_received_map;
+    bool                                  m_has_received_map = false;
+    std::map<std::string, std::uint64_t>  m_stored_hashes;
+    bool                                  m_stop_conversion = false;
+    std::thread                           m_conversion_thread;
+
     bool read(yarp::os::ConnectionReader& connection) override;
 
     bool updateVizMarkers(std::string map_name = "ros_map");
     bool subscribeMapFromRos(std::string map_name = "ros_map");
+    bool storeRosMap(const yarp::rosmsg::nav_msgs::OccupancyGrid& map_ros, const std::string& map_name);
+    void conversionLoop();
+    bool isMapStored(const std::string& map_name);
+    void clearStoredHashes();
+    void stopConversionThread();
     bool publishMapToRos(std::string map_name = "ros_map");
+    void publishPyramid(const std::string& map_name, const yarp::rosmsg::nav_msgs::OccupancyGrid& grid);
+    void sendMap(const std::string& map_name, const yarp::rosmsg::nav_msgs::OccupancyGrid& grid);
+    bool publishMapUpdates(const std::string& map_name, const yarp::rosmsg::nav_msgs::OccupancyGrid& ogrid);
 };
 
 #endif // YARP_DEV_MAP2D_NWS_ROS_H
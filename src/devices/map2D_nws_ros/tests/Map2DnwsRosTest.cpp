@@ -3,15 +3,34 @@
  * SPDX-License-Identifier: BSD-3-Clause
  */
 
+#include "Map2D_nws_ros.h"
+
+#include <yarp/dev/GenericVocabs.h>
 #include <yarp/dev/INavigation2D.h>
 #include <yarp/dev/IMap2D.h>
 #include <yarp/dev/Map2DLocation.h>
 #include <yarp/dev/Map2DArea.h>
 #include <yarp/os/Network.h>
 #include <yarp/os/LogStream.h>
+#include <yarp/os/Node.h>
+#include <yarp/os/RpcClient.h>
+#include <yarp/os/Subscriber.h>
+#include <yarp/os/SystemClock.h>
 #include <yarp/dev/PolyDriver.h>
 #include <yarp/dev/WrapperSingle.h>
 #include <yarp/dev/tests/IMap2DTest.h>
+#include <yarp/math/Math.h>
+#include <yarp/math/Quaternion.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <catch2/catch_amalgamated.hpp>
 #include <harness.h>
@@ -21,6 +40,74 @@ using namespace yarp::dev::Nav2D;
 using namespace yarp::sig;
 using namespace yarp::os;
 
+namespace {
+// A square map with walls, free space and unknown cells
+MapGrid2D makeTestMap(size_t size)
+{
+    MapGrid2D map;
+    map.setSize_in_cells(size, size);
+    map.setResolution(0.05);
+    map.setMapName("test_map");
+    ImageOf<PixelMono> occupancy;
+    occupancy.resize(size, size);
+    for (size_t y = 0; y < size; y++) {
+        for (size_t x = 0; x < size; x++) {
+            occupancy.pixel(x, y) = (x % 97 == 0 || y % 89 == 0) ? 100 : ((x + 3 * y) % 13 == 0 ? 255 : (x + y) % 50);
+        }
+    }
+    map.setOccupancyGrid(occupancy);
+    return map;
+}
+
+// The cell by cell conversion, used as reference
+void occupancyToRosPerCell(const MapGrid2D& map, std::vector<std::int8_t>& data)
+{
+    data.resize(map.width() * map.height());
+    size_t index = 0;
+    double tmp = 0;
+    XYCell cell;
+    for (cell.y = map.height(); cell.y-- > 0;) {
+        for (cell.x = 0; cell.x < map.width(); cell.x++) {
+            map.getOccupancyData(cell, tmp);
+            data[index++] = (int)tmp;
+        }
+    }
+}
+
+// The cell by cell import, used as reference
+void occupancyFromRosPerCell(const std::vector<std::int8_t>& data, size_t width, size_t height, int free_threshold, int wall_threshold, MapGrid2D& map)
+{
+    for (size_t y = 0; y < height; y++) {
+        for (size_t x = 0; x < width; x++) {
+            XYCell cell(x, height - 1 - y);
+            double occ = data[x + y * width];
+            map.setOccupancyData(cell, occ);
+            if (occ >= 0 && occ <= free_threshold) {
+                map.setMapFlag(cell, MapGrid2D::MAP_CELL_FREE);
+            } else if (occ >= wall_threshold && occ <= 100) {
+                map.setMapFlag(cell, MapGrid2D::MAP_CELL_WALL);
+            } else {
+                map.setMapFlag(cell, MapGrid2D::MAP_CELL_UNKNOWN);
+            }
+        }
+    }
+}
+
+template <typename T>
+bool sameImage(const ImageOf<T>& a, const ImageOf<T>& b)
+{
+    if (a.width() != b.width() || a.height() != b.height()) {
+        return false;
+    }
+    for (size_t y = 0; y < a.height(); y++) {
+        if (std::memcmp(a.getRow(y), b.getRow(y), a.width() * sizeof(T)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+} // namespace
+
 TEST_CASE("dev::map2D_nws_ros_Test", "[yarp::dev]")
 {
     YARP_REQUIRE_PLUGIN("map2D_nws_ros", "device");
@@ -44,5 +131,707 @@ TEST_CASE("dev::map2D_nws_ros_Test", "[yarp::dev]")
         }
     }
 
+    SECTION("Publishing and listing the maps through the rpc port")
+    {
+        YARP_REQUIRE_PLUGIN("map2DStorage", "device");
+
+        PolyDriver ddstorage;
+        PolyDriver ddmapserver;
+        {
+            Property p_cfg;
+            p_cfg.put("device", "map2DStorage");
+            REQUIRE(ddstorage.open(p_cfg));
+        }
+        {
+            Property p_cfg;
+            p_cfg.put("device", "map2D_nws_ros");
+            p_cfg.put("name", "/map2D_nws_ros_test/rpc");
+            p_cfg.fromString("(ROS (enable_publisher true) (latch_period 0.1))", false);
+            REQUIRE(ddmapserver.open(p_cfg));
+        }
+        IMap2D* imap = nullptr;
+        WrapperSingle* wrapper = nullptr;
+        REQUIRE(ddstorage.view(imap));
+        REQUIRE(ddmapserver.view(wrapper));
+        REQUIRE(wrapper->attach(&ddstorage));
+        REQUIRE(imap->store_map(makeTestMap(100)));
+
+        RpcClient client;
+        REQUIRE(client.open("/map2D_nws_ros_test/client"));
+        REQUIRE(Network::connect("/map2D_nws_ros_test/client", "/map2D_nws_ros_test/rpc"));
+
+        Bottle cmd;
+        Bottle reply;
+        cmd.addString("list");
+        REQUIRE(client.write(cmd, reply));
+        CHECK(reply.get(0).asVocab32() == VOCAB_OK);
+        REQUIRE(reply.get(1).isList());
+        CHECK(reply.get(1).asList()->get(0).asString() == "test_map");
+
+        cmd.clear();
+        reply.clear();
+        cmd.addString("publish");
+        cmd.addString("test_map");
+        REQUIRE(client.write(cmd, reply));
+        CHECK(reply.get(0).asVocab32() == VOCAB_OK);
+
+        cmd.clear();
+        reply.clear();
+        cmd.addString("publish");
+        cmd.addString("missing_map");
+        REQUIRE(client.write(cmd, reply));
+        CHECK(reply.get(0).asVocab32() == VOCAB_ERR);
+
+        // A subscriber connecting after the publication receives the cached map once
+        {
+            Node node("/map2D_nws_ros_test_reader");
+            Subscriber<yarp::rosmsg::nav_msgs::OccupancyGrid> reader;
+            REQUIRE(reader.topic("/map"));
+            size_t received = 0;
+            double start = SystemClock::nowSystem();
+            while (SystemClock::nowSystem() - start < 2.0 && received == 0)
+            {
+                yarp::rosmsg::nav_msgs::OccupancyGrid* map = reader.read(false);
+                if (map != nullptr)
+                {
+                    received++;
+                    CHECK(map->info.width == 100);
+                    CHECK(map->info.height == 100);
+                    CHECK(map->data.size() == 100 * 100);
+                }
+                SystemClock::delaySystem(0.01);
+            }
+            // No other map is sent while nothing changes, after several periods of the thread
+            SystemClock::delaySystem(0.5);
+            while (reader.read(false) != nullptr) {
+                received++;
+            }
+            CHECK(received == 1);
+            reader.close();
+        }
+
+        // Markers of the locations, sent again after every change
+        Map2DLocation loc;
+        loc.map_id = "test_map";
+        loc.x = 1.0;
+        loc.y = 2.0;
+        loc.theta = 90.0;
+        REQUIRE(imap->storeLocation("kitchen", loc));
+        REQUIRE(imap->storeLocation("office", loc));
+        for (int i = 0; i < 3; i++)
+        {
+            cmd.clear();
+            reply.clear();
+            cmd.addString("markers");
+            REQUIRE(client.write(cmd, reply));
+            CHECK(reply.get(0).asVocab32() == VOCAB_OK);
+            if (i == 0) {
+                REQUIRE(imap->deleteLocation("office"));
+            }
+        }
+
+        client.close();
+        CHECK(wrapper->detach());
+        CHECK(ddmapserver.close());
+        CHECK(ddstorage.close());
+    }
+
+    SECTION("Malformed received maps do not stop the conversion")
+    {
+        YARP_REQUIRE_PLUGIN("map2DStorage", "device");
+
+        PolyDriver ddstorage;
+        {
+            Property p_cfg;
+            p_cfg.put("device", "map2DStorage");
+            REQUIRE(ddstorage.open(p_cfg));
+        }
+        IMap2D* imap = nullptr;
+        REQUIRE(ddstorage.view(imap));
+
+        Map2D_nws_ros server;
+        {
+            Property p_cfg;
+            p_cfg.put("name", "/map2D_nws_ros_test/rpc");
+            p_cfg.fromString("(ROS (enable_subscriber true) (subscriber_topic /map_rle_in) (subscriber_map_name header) (subscriber_map_encoding rle))", false);
+            REQUIRE(server.open(p_cfg));
+        }
+        REQUIRE(server.attach(&ddstorage));
+
+        yarp::rosmsg::nav_msgs::OccupancyGrid valid;
+        valid.info.width = 100;
+        valid.info.height = 100;
+        valid.info.resolution = 0.05f;
+        valid.info.origin.orientation.w = 1;
+        Map2D_nws_ros::encodeRle(std::vector<std::int8_t>(100 * 100, 0), valid.data);
+
+        // A truncated stream, and a header much larger than the data
+        yarp::rosmsg::nav_msgs::OccupancyGrid truncated = valid;
+        truncated.header.frame_id = "truncated";
+        truncated.data.pop_back();
+        yarp::rosmsg::nav_msgs::OccupancyGrid oversized = valid;
+        oversized.header.frame_id = "oversized";
+        oversized.info.width = 4000000000U;
+        oversized.info.height = 4000000000U;
+        valid.header.frame_id = "valid";
+        yarp::rosmsg::nav_msgs::OccupancyGrid same = valid;
+        for (auto* map : { &truncated, &oversized, &valid })
+        {
+            server.mapReceived(*map);
+            yarp::os::SystemClock::delaySystem(0.1);
+        }
+
+        // Only the valid map is stored, after the others have been discarded
+        bool stored = false;
+        for (int i = 0; i < 200 && !stored; i++)
+        {
+            std::vector<std::string> names;
+            imap->get_map_names(names);
+            stored = std::find(names.begin(), names.end(), "valid") != names.end();
+            CHECK(std::find(names.begin(), names.end(), "truncated") == names.end());
+            CHECK(std::find(names.begin(), names.end(), "oversized") == names.end());
+            yarp::os::SystemClock::delaySystem(0.01);
+        }
+        CHECK(stored);
+
+        // The same map is stored again if it has been removed from the device meanwhile
+        REQUIRE(imap->remove_map("valid"));
+        server.mapReceived(same);
+        stored = false;
+        for (int i = 0; i < 200 && !stored; i++)
+        {
+            std::vector<std::string> names;
+            imap->get_map_names(names);
+            stored = std::find(names.begin(), names.end(), "valid") != names.end();
+            yarp::os::SystemClock::delaySystem(0.01);
+        }
+        CHECK(stored);
+
+        CHECK(server.detach());
+        CHECK(server.close());
+        CHECK(ddstorage.close());
+    }
+
+    Network::setLocalMode(false);
+}
+
+TEST_CASE("dev::map2D_nws_ros_conversion_Test", "[yarp::dev]")
+{
+    SECTION("Bulk export of the occupancy to ROS")
+    {
+        for (size_t size : {100, 257})
+        {
+            MapGrid2D map = makeTestMap(size);
+            std::vector<std::int8_t> reference;
+            occupancyToRosPerCell(map, reference);
+            std::vector<std::int8_t> data;
+            Map2D_nws_ros::occupancyToRos(map, data);
+            CHECK(data == reference);
+        }
+    }
+
+    SECTION("Bulk import of the occupancy from ROS")
+    {
+        std::mt19937 gen(42);
+        std::uniform_int_distribution<int> values(-1, 100);
+        // 1000 x 1000 is the smallest map converted by several threads
+        for (size_t size : {257, 1000})
+        {
+            for (auto thresholds : {std::make_pair(70, 71), std::make_pair(40, 90)})
+            {
+                std::vector<std::int8_t> data(size * size);
+                for (auto& d : data) {
+                    d = static_cast<std::int8_t>(values(gen));
+                }
+                data[0] = -100;
+                data[1] = 120;
+
+                MapGrid2D reference;
+                reference.setSize_in_cells(size, size);
+                occupancyFromRosPerCell(data, size, size, thresholds.first, thresholds.second, reference);
+
+                MapGrid2D map;
+                map.setSize_in_cells(size, size);
+                REQUIRE(Map2D_nws_ros::occupancyFromRos(data, size, size, thresholds.first, thresholds.second, map));
+
+                ImageOf<PixelMono> occ1;
+                ImageOf<PixelMono> occ2;
+                ImageOf<PixelRgb> flags1;
+                ImageOf<PixelRgb> flags2;
+                reference.getOccupancyGrid(occ1);
+                map.getOccupancyGrid(occ2);
+                reference.getMapImage(flags1);
+                map.getMapImage(flags2);
+                CHECK(sameImage(occ1, occ2));
+                CHECK(sameImage(flags1, flags2));
+            }
+        }
+
+        MapGrid2D wrongSize;
+        wrongSize.setSize_in_cells(10, 10);
+        std::vector<std::int8_t> data(99);
+        CHECK_FALSE(Map2D_nws_ros::occupancyFromRos(data, 10, 10, 70, 71, wrongSize));
+    }
+
+    SECTION("Dirty rectangles between two versions of a map")
+    {
+        const size_t width = 1000;
+        const size_t height = 700;
+        std::vector<std::int8_t> before(width * height, 0);
+
+        CHECK(Map2D_nws_ros::computeDirtyRectangles(before, before, width, height).empty());
+
+        // A single cell in the last, partial, tile
+        std::vector<std::int8_t> after = before;
+        after[699 * width + 999] = 100;
+        auto patches = Map2D_nws_ros::computeDirtyRectangles(before, after, width, height);
+        REQUIRE(patches.size() == 1);
+        CHECK(patches[0].x == 960);
+        CHECK(patches[0].y == 640);
+        CHECK(patches[0].width == 40);
+        CHECK(patches[0].height == 60);
+
+        // A vertical wall and a distant cell: two rectangles covering all the changes, without overlaps
+        after = before;
+        for (size_t y = 100; y < 500; y++) {
+            after[y * width + 300] = 100;
+        }
+        after[10 * width + 900] = -1;
+        patches = Map2D_nws_ros::computeDirtyRectangles(before, after, width, height);
+        CHECK(patches.size() == 2);
+        std::vector<int> coverage(width * height, 0);
+        for (const auto& p : patches) {
+            for (size_t y = p.y; y < p.y + p.height; y++) {
+                for (size_t x = p.x; x < p.x + p.width; x++) {
+                    coverage[y * width + x]++;
+                }
+            }
+        }
+        bool covered = true;
+        bool overlapping = false;
+        for (size_t i = 0; i < width * height; i++) {
+            covered &= (before[i] == after[i] || coverage[i] == 1);
+            overlapping |= (coverage[i] > 1);
+        }
+        CHECK(covered);
+        CHECK_FALSE(overlapping);
+    }
+
+    SECTION("Closed form yaw to quaternion")
+    {
+        for (double yaw : { -3.0, -1.2, 0.0, 0.5, 1.5707963267948966, 3.1 })
+        {
+            yarp::sig::Vector rpy(3, 0.0);
+            rpy[2] = yaw;
+            yarp::math::Quaternion expected;
+            expected.fromRotationMatrix(yarp::math::rpy2dcm(rpy));
+            yarp::rosmsg::geometry_msgs::Quaternion q;
+            Map2D_nws_ros::yawToQuaternion(yaw, q);
+            // q and -q represent the same rotation
+            double dot = q.x * expected.x() + q.y * expected.y() + q.z * expected.z() + q.w * expected.w();
+            CHECK(std::abs(std::abs(dot) - 1.0) < 1e-9);
+        }
+    }
+
+    SECTION("Only the changed markers are published")
+    {
+        using yarp::rosmsg::visualization_msgs::Marker;
+        using yarp::rosmsg::visualization_msgs::MarkerArray;
+
+        Marker prototype;
+        prototype.header.frame_id = "map";
+        std::map<std::string, Map2D_nws_ros::MarkerLocation> cache;
+        std::int32_t next_id = 1;
+        std::vector<std::string> names = { "kitchen", "office" };
+        std::vector<Map2DLocation> locations = { Map2DLocation("test_map", 1.0, 2.0, 90.0),
+                                                 Map2DLocation("test_map", 3.0, 4.0, 0.0) };
+
+        // New locations
+        MarkerArray markers;
+        Map2D_nws_ros::diffMarkers(names, locations, false, prototype, cache, next_id, markers);
+        REQUIRE(markers.markers.size() == 2);
+        CHECK(markers.markers[0].action == Marker::ADD);
+        CHECK(markers.markers[0].id == 1);
+        CHECK(markers.markers[0].text == "kitchen");
+        CHECK(markers.markers[0].pose.position.x == 1.0);
+        CHECK(markers.markers[0].header.frame_id == "map");
+        CHECK(markers.markers[1].action == Marker::ADD);
+        CHECK(markers.markers[1].id == 2);
+        CHECK(markers.markers[1].text == "office");
+
+        // Nothing changed
+        markers.markers.clear();
+        Map2D_nws_ros::diffMarkers(names, locations, false, prototype, cache, next_id, markers);
+        CHECK(markers.markers.empty());
+
+        // A moved location keeps its id
+        locations[1].x = 5.0;
+        markers.markers.clear();
+        Map2D_nws_ros::diffMarkers(names, locations, false, prototype, cache, next_id, markers);
+        REQUIRE(markers.markers.size() == 1);
+        CHECK(markers.markers[0].action == Marker::ADD);
+        CHECK(markers.markers[0].id == 2);
+        CHECK(markers.markers[0].pose.position.x == 5.0);
+
+        // A removed location, and a new one with a new id
+        names = { "office", "lab" };
+        locations = { locations[1], Map2DLocation("test_map", 6.0, 7.0, 0.0) };
+        markers.markers.clear();
+        Map2D_nws_ros::diffMarkers(names, locations, false, prototype, cache, next_id, markers);
+        REQUIRE(markers.markers.size() == 2);
+        CHECK(markers.markers[0].action == Marker::ADD);
+        CHECK(markers.markers[0].id == 3);
+        CHECK(markers.markers[0].text == "lab");
+        CHECK(markers.markers[1].action == Marker::DELETE);
+        CHECK(markers.markers[1].id == 1);
+        CHECK(markers.markers[1].text == "kitchen");
+
+        // All the current locations for a new subscriber
+        markers.markers.clear();
+        Map2D_nws_ros::diffMarkers(names, locations, true, prototype, cache, next_id, markers);
+        REQUIRE(markers.markers.size() == 2);
+        CHECK(markers.markers[0].action == Marker::ADD);
+        CHECK(markers.markers[1].action == Marker::ADD);
+        CHECK(cache.size() == 2);
+    }
+
+    SECTION("Run-length encoding of the occupancy")
+    {
+        // An empty map, a single cell, runs longer than 127 and 16383 cells
+        std::vector<std::vector<std::int8_t>> inputs;
+        inputs.emplace_back();
+        inputs.emplace_back(1, static_cast<std::int8_t>(-1));
+        inputs.emplace_back(200, static_cast<std::int8_t>(0));
+        inputs.back().resize(100000, 100);
+        for (const auto& in : inputs)
+        {
+            std::vector<std::int8_t> encoded;
+            std::vector<std::int8_t> decoded;
+            Map2D_nws_ros::encodeRle(in, encoded);
+            CHECK(Map2D_nws_ros::decodeRle(encoded, in.size(), decoded));
+            CHECK(decoded == in);
+        }
+
+        // A map
+        std::vector<std::int8_t> data;
+        Map2D_nws_ros::occupancyToRos(makeTestMap(500), data);
+        std::vector<std::int8_t> encoded;
+        std::vector<std::int8_t> decoded;
+        Map2D_nws_ros::encodeRle(data, encoded);
+        CHECK(encoded.size() < data.size());
+        CHECK(Map2D_nws_ros::decodeRle(encoded, data.size(), decoded));
+        CHECK(decoded == data);
+
+        // Malformed data
+        std::vector<std::int8_t> truncated(encoded.begin(), encoded.end() - 1);
+        CHECK_FALSE(Map2D_nws_ros::decodeRle(truncated, data.size(), decoded));
+        CHECK_FALSE(Map2D_nws_ros::decodeRle(encoded, data.size() - 1, decoded));
+        CHECK_FALSE(Map2D_nws_ros::decodeRle(encoded, data.size() + 1, decoded));
+
+        // Sizes that the data cannot produce are rejected without allocating them
+        std::vector<std::int8_t> oversized;
+        Map2D_nws_ros::encodeRle(std::vector<std::int8_t>(1000, 0), oversized);
+        decoded.clear();
+        CHECK_FALSE(Map2D_nws_ros::decodeRle(oversized, 1000000ULL * 1000000ULL, decoded));
+        CHECK_FALSE(Map2D_nws_ros::decodeRle(oversized, Map2D_nws_ros::maxRosMapCells + 1, decoded));
+        CHECK_FALSE(Map2D_nws_ros::decodeRle(oversized, 100000000, decoded));
+        CHECK(decoded.empty());
+        // A single run claiming more cells than the limit
+        std::vector<std::int8_t> hugeRun = { 0, -128, -128, -128, -128, 2 };
+        CHECK_FALSE(Map2D_nws_ros::decodeRle(hugeRun, Map2D_nws_ros::maxRosMapCells, decoded));
+        CHECK(decoded.empty());
+    }
+
+    SECTION("Hash of the received maps")
+    {
+        yarp::rosmsg::nav_msgs::OccupancyGrid map;
+        map.info.width = 100;
+        map.info.height = 50;
+        map.info.resolution = 0.05f;
+        map.info.origin.orientation.w = 1;
+        map.data.assign(100 * 50, 0);
+        std::uint64_t hash = Map2D_nws_ros::hashRosMap(map);
+
+        yarp::rosmsg::nav_msgs::OccupancyGrid same = map;
+        same.header.frame_id = "other_frame";
+        CHECK(Map2D_nws_ros::hashRosMap(same) == hash);
+
+        yarp::rosmsg::nav_msgs::OccupancyGrid changedCell = map;
+        changedCell.data[1234] = 100;
+        CHECK(Map2D_nws_ros::hashRosMap(changedCell) != hash);
+
+        yarp::rosmsg::nav_msgs::OccupancyGrid changedGeometry = map;
+        changedGeometry.info.width = 50;
+        changedGeometry.info.height = 100;
+        CHECK(Map2D_nws_ros::hashRosMap(changedGeometry) != hash);
+
+        yarp::rosmsg::nav_msgs::OccupancyGrid changedOrigin = map;
+        changedOrigin.info.origin.position.x = 1.0;
+        CHECK(Map2D_nws_ros::hashRosMap(changedOrigin) != hash);
+    }
+
+    SECTION("Max pooling of the pyramid levels")
+    {
+        // A 5 x 3 map, the last column and row are blocks of a single row or column
+        yarp::rosmsg::nav_msgs::OccupancyGrid map;
+        map.header.frame_id = "map";
+        map.info.width = 5;
+        map.info.height = 3;
+        map.info.resolution = 0.05f;
+        map.info.origin.position.x = -1.0;
+        map.info.origin.position.y = 2.0;
+        map.info.origin.orientation.w = 1;
+        map.data = { 0, -1,  -1, -1,  100,
+                    -1, 30,  -1, -1,  -1,
+                    -1, -1,   0, 50,  -1 };
+        yarp::rosmsg::nav_msgs::OccupancyGrid level;
+        Map2D_nws_ros::downsampleRosMap(map, level);
+        CHECK(level.header.frame_id == "map");
+        CHECK(level.info.width == 3);
+        CHECK(level.info.height == 2);
+        CHECK(level.info.resolution == 0.05f * 2);
+        CHECK(level.info.origin.position.x == -1.0);
+        CHECK(level.info.origin.position.y == 2.0);
+        std::vector<std::int8_t> expected = { 30, -1, 100,
+                                              -1, 50,  -1 };
+        CHECK(level.data == expected);
+
+        // Two 2x levels are the same as a direct 4x max pooling
+        std::vector<std::int8_t> data;
+        Map2D_nws_ros::occupancyToRos(makeTestMap(200), data);
+        map.info.width = 200;
+        map.info.height = 200;
+        map.data = data;
+        yarp::rosmsg::nav_msgs::OccupancyGrid level4;
+        Map2D_nws_ros::downsampleRosMap(map, level);
+        Map2D_nws_ros::downsampleRosMap(level, level4);
+        REQUIRE(level4.info.width == 50);
+        REQUIRE(level4.info.height == 50);
+        CHECK(level4.info.resolution == 0.05f * 4);
+        bool same = true;
+        for (size_t y = 0; y < 50 && same; y++)
+        {
+            for (size_t x = 0; x < 50 && same; x++)
+            {
+                std::int8_t pooled = -1;
+                for (size_t j = 0; j < 4; j++)
+                {
+                    for (size_t i = 0; i < 4; i++)
+                    {
+                        std::int8_t v = data[(y * 4 + j) * 200 + x * 4 + i];
+                        if (v > pooled) {
+                            pooled = v;
+                        }
+                    }
+                }
+                same = (level4.data[y * 50 + x] == pooled);
+            }
+        }
+        CHECK(same);
+    }
+}
+
+// Timings of the conversions on large maps, against the cell by cell references.
+// Hidden, run it with: harness_dev_map2D_nws_ros "[.benchmark]"
+TEST_CASE("dev::map2D_nws_ros_benchmark_Test", "[yarp::dev][.benchmark]")
+{
+    SECTION("Export of the occupancy to ROS, 1k, 4k and 8k maps")
+    {
+        for (size_t size : {1000, 4000, 8000})
+        {
+            MapGrid2D map = makeTestMap(size);
+            std::vector<std::int8_t> data;
+            std::string name = std::to_string(size) + " x " + std::to_string(size) + " map export";
+            BENCHMARK(name + ", per cell")
+            {
+                occupancyToRosPerCell(map, data);
+                return data.size();
+            };
+            BENCHMARK(name + ", bulk")
+            {
+                Map2D_nws_ros::occupancyToRos(map, data);
+                return data.size();
+            };
+        }
+    }
+
+    SECTION("Import of the occupancy from ROS, 1k and 4k maps")
+    {
+        for (size_t size : {1000, 4000})
+        {
+            std::vector<std::int8_t> data;
+            Map2D_nws_ros::occupancyToRos(makeTestMap(size), data);
+            MapGrid2D map;
+            map.setSize_in_cells(size, size);
+            std::string name = std::to_string(size) + " x " + std::to_string(size) + " map import";
+            BENCHMARK(name + ", per cell")
+            {
+                occupancyFromRosPerCell(data, size, size, 70, 71, map);
+                return map.width();
+            };
+            BENCHMARK(name + ", bulk")
+            {
+                return Map2D_nws_ros::occupancyFromRos(data, size, size, 70, 71, map);
+            };
+        }
+    }
+
+    SECTION("Run-length encoding and pyramid of a 4k map")
+    {
+        yarp::rosmsg::nav_msgs::OccupancyGrid grid;
+        grid.info.width = 4000;
+        grid.info.height = 4000;
+        grid.info.resolution = 0.05f;
+        Map2D_nws_ros::occupancyToRos(makeTestMap(4000), grid.data);
+        std::vector<std::int8_t> encoded;
+        std::vector<std::int8_t> decoded;
+        Map2D_nws_ros::encodeRle(grid.data, encoded);
+        yInfo() << "4000 x 4000 map encoded from" << grid.data.size() << "to" << encoded.size() << "bytes, ratio"
+                << static_cast<double>(grid.data.size()) / encoded.size();
+        BENCHMARK("4000 x 4000 map RLE encoding")
+        {
+            Map2D_nws_ros::encodeRle(grid.data, encoded);
+            return encoded.size();
+        };
+        BENCHMARK("4000 x 4000 map RLE decoding")
+        {
+            return Map2D_nws_ros::decodeRle(encoded, grid.data.size(), decoded);
+        };
+        yarp::rosmsg::nav_msgs::OccupancyGrid level2;
+        yarp::rosmsg::nav_msgs::OccupancyGrid level4;
+        BENCHMARK("4000 x 4000 map pooled to 2x and 4x")
+        {
+            Map2D_nws_ros::downsampleRosMap(grid, level2);
+            Map2D_nws_ros::downsampleRosMap(level2, level4);
+            return level4.data.size();
+        };
+    }
+}
+
+// Concurrent rpc commands, imports and attach/detach on a large map.
+// Besides the checks, it is meant to be run in a build with -fsanitize=thread.
+TEST_CASE("dev::map2D_nws_ros_stress_Test", "[yarp::dev]")
+{
+    YARP_REQUIRE_PLUGIN("map2DStorage", "device");
+
+    Network::setLocalMode(true);
+
+    PolyDriver ddstorage;
+    {
+        Property p_cfg;
+        p_cfg.put("device", "map2DStorage");
+        REQUIRE(ddstorage.open(p_cfg));
+    }
+    IMap2D* imap = nullptr;
+    REQUIRE(ddstorage.view(imap));
+    REQUIRE(imap->store_map(makeTestMap(2000)));
+    for (int i = 0; i < 100; i++)
+    {
+        Map2DLocation loc;
+        loc.map_id = "test_map";
+        loc.x = i;
+        loc.theta = i;
+        REQUIRE(imap->storeLocation("location_" + std::to_string(i), loc));
+    }
+
+    Map2D_nws_ros server;
+    {
+        Property p_cfg;
+        p_cfg.put("name", "/map2D_nws_ros_stress/rpc");
+        p_cfg.fromString("(ROS (enable_publisher true) (enable_subscriber true) (subscriber_topic /map_stress_in) (latch_period 0.01))", false);
+        REQUIRE(server.open(p_cfg));
+    }
+    REQUIRE(server.attach(&ddstorage));
+
+    constexpr size_t clients = 4;
+    constexpr size_t iterations = 20;
+    std::atomic<size_t> failures{0};
+    auto rpcClient = [&failures](size_t c, bool count_failures) {
+        RpcClient client;
+        std::string name = "/map2D_nws_ros_stress/client" + std::to_string(c);
+        if (!client.open(name) || !Network::connect(name, "/map2D_nws_ros_stress/rpc")) {
+            failures++;
+            return;
+        }
+        const char* commands[] = { "publish", "list", "markers" };
+        for (size_t i = 0; i < iterations; i++)
+        {
+            Bottle cmd;
+            Bottle reply;
+            cmd.addString(commands[(i + c) % 3]);
+            if ((i + c) % 3 == 0) {
+                cmd.addString("test_map");
+            }
+            bool ok = client.write(cmd, reply) && reply.get(0).asVocab32() == VOCAB_OK;
+            if (!ok && count_failures) {
+                failures++;
+            }
+        }
+        client.close();
+    };
+
+    SECTION("Concurrent publications, markers and imports")
+    {
+        std::vector<std::thread> threads;
+        for (size_t c = 0; c < clients; c++) {
+            threads.emplace_back(rpcClient, c, true);
+        }
+        // The imports take the exclusive access to the device
+        threads.emplace_back([&server]() {
+            for (int i = 0; i < 10; i++)
+            {
+                yarp::rosmsg::nav_msgs::OccupancyGrid grid;
+                grid.info.width = 500;
+                grid.info.height = 500;
+                grid.info.resolution = 0.05f;
+                grid.info.origin.orientation.w = 1;
+                grid.data.assign(500 * 500, static_cast<std::int8_t>(i * 10));
+                server.mapReceived(grid);
+                yarp::os::SystemClock::delaySystem(0.01);
+            }
+        });
+        for (auto& t : threads) {
+            t.join();
+        }
+        CHECK(failures == 0);
+
+        // The last received map is eventually stored, named after the topic
+        bool stored = false;
+        for (int i = 0; i < 500 && !stored; i++)
+        {
+            std::vector<std::string> names;
+            imap->get_map_names(names);
+            stored = std::find(names.begin(), names.end(), "map_stress_in") != names.end();
+            yarp::os::SystemClock::delaySystem(0.01);
+        }
+        CHECK(stored);
+    }
+
+    SECTION("Rpc commands while the device is attached and detached")
+    {
+        std::atomic<bool> done{false};
+        std::thread attacher([&server, &ddstorage, &done]() {
+            while (!done)
+            {
+                server.detach();
+                server.attach(&ddstorage);
+            }
+        });
+        std::vector<std::thread> threads;
+        for (size_t c = 0; c < clients; c++) {
+            threads.emplace_back(rpcClient, c, false);
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        done = true;
+        attacher.join();
+        CHECK(failures == 0);
+    }
+
+    CHECK(server.detach());
+    CHECK(server.close());
+    CHECK(ddstorage.close());
+
     Network::setLocalMode(false);
 }
@@ -11,6 +11,8 @@
 #include <yarp/os/Log.h>
 #include <yarp/os/LogComponent.h>
 #include <yarp/os/LogStream.h>
+#include <yarp/os/SystemClock.h>
+#include <algorithm>
 #include <mutex>
 
 /*! \file MobileBaseVelocityControl_nws_ros.cpp */
@@ -26,14 +28,14 @@ namespace {
 
 //------------------------------------------------------------------------------------------------------------------------------
 
-void commandSubscriber::init(yarp::dev::Nav2D::INavigation2DVelocityActions* _iNavVel)
+void commandSubscriber::init(MobileBaseVelocityControl_nws_ros* owner)
 {
-    m_iNavVel = _iNavVel;
+    m_owner = owner;
 }
 
 void commandSubscriber::deinit()
 {
-    m_iNavVel = nullptr;
+    m_owner = nullptr;
 }
 
 commandSubscriber::commandSubscriber()
@@ -47,13 +49,9 @@ commandSubscriber::~commandSubscriber()
 
 void commandSubscriber::onRead(yarp::rosmsg::geometry_msgs::Twist& v)
 {
-    if (m_iNavVel)
-    {
-        m_iNavVel->applyVelocityCommand(v.linear.x, v.linear.y, v.angular.z * 180 / M_PI);
-    }
-    else
+    if (m_owner)
     {
-        yCError(MOBVEL_NWS_ROS, "Subdevice interface not yet initialized");
+        m_owner->commandReceived(v);
     }
 }
 
@@ -71,11 +69,38 @@ bool MobileBaseVelocityControl_nws_ros::open(yarp::os::Searchable& config)
         m_ros_topic_name = config.find("topic_name").asString();
     }
 
+    m_max_rate = config.check("max_rate", Value(0.0)).asFloat64();
+    m_watchdog_timeout = config.check("watchdog_timeout", Value(0.0)).asFloat64();
+    m_stats_report_period = config.check("stats_report_period", Value(5.0)).asFloat64();
+    if (m_max_rate < 0 || m_watchdog_timeout < 0 || m_stats_report_period < 0)
+    {
+        yCError(MOBVEL_NWS_ROS) << "'max_rate', 'watchdog_timeout' and 'stats_report_period' must not be negative";
+        return false;
+    }
+    if (m_watchdog_timeout > 0 && m_max_rate == 0)
+    {
+        yCWarning(MOBVEL_NWS_ROS) << "'watchdog_timeout' is only used when 'max_rate' is set";
+    }
+    if (config.check("latency_topic_name") == true)
+    {
+        m_latency_topic_name = config.find("latency_topic_name").asString();
+        if (m_latency_topic_name[0] != '/')
+        {
+            yCError(MOBVEL_NWS_ROS) << "latency_topic_name must begin with an initial /";
+            return false;
+        }
+        if (m_max_rate == 0)
+        {
+            yCWarning(MOBVEL_NWS_ROS) << "'latency_topic_name' is only used when 'max_rate' is set";
+        }
+    }
+
     yCInfo(MOBVEL_NWS_ROS) << "Waiting for device to be attached";
 
     //open the subscriber
     m_ros_node = new yarp::os::Node(m_ros_node_name);
     m_command_subscriber = new commandSubscriber();
+    m_command_subscriber->init(this);
 
     if (!m_command_subscriber->topic(m_ros_topic_name))
     {
@@ -83,14 +108,36 @@ bool MobileBaseVelocityControl_nws_ros::open(yarp::os::Searchable& config)
         return false;
     }
 
+    if (!m_latency_topic_name.empty() && !m_latency_publisher.topic(m_latency_topic_name))
+    {
+        yCError(MOBVEL_NWS_ROS) << " opening " << m_latency_topic_name << " Topic, check your yarp-ROS network configuration\n";
+        return false;
+    }
+
     //m_command_subscriber->setStrict();
     m_command_subscriber->useCallback();
 
+    if (m_max_rate > 0)
+    {
+        setPeriod(1.0 / m_max_rate);
+        if (!start())
+        {
+            yCError(MOBVEL_NWS_ROS) << "Unable to start the command thread";
+            return false;
+        }
+    }
+
     return true;
 }
 
 bool MobileBaseVelocityControl_nws_ros::close()
 {
+    if (isRunning()) { stop(); }
+    if (!m_latency_topic_name.empty())
+    {
+        m_latency_publisher.interrupt();
+        m_latency_publisher.close();
+    }
     if (m_command_subscriber) {delete m_command_subscriber;}
     if (m_ros_node) {delete m_ros_node;}
     if (m_subdev.isValid()) { m_subdev.close(); }
@@ -100,7 +147,8 @@ bool MobileBaseVelocityControl_nws_ros::close()
 
 bool MobileBaseVelocityControl_nws_ros::detach()
 {
-    m_command_subscriber->deinit();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_iNavVel = nullptr;
     return true;
 }
 
@@ -119,7 +167,125 @@ bool MobileBaseVelocityControl_nws_ros::attach(PolyDriver* driver)
         return false;
     }
 
-    m_command_subscriber->init(iNavVel);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_iNavVel = iNavVel;
 
     return true;
 }
+
+void MobileBaseVelocityControl_nws_ros::commandReceived(const yarp::rosmsg::geometry_msgs::Twist& v)
+{
+    VelocityCommand cmd;
+    cmd.x_vel = v.linear.x;
+    cmd.y_vel = v.linear.y;
+    cmd.theta_vel = v.angular.z * 180 / M_PI;
+    cmd.received_time = SystemClock::nowSystem();
+
+    if (m_max_rate == 0)
+    {
+        applyCommand(cmd);
+        return;
+    }
+
+    bool coalesced = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mailbox_mutex);
+        coalesced = m_mailbox_full;
+        m_mailbox = cmd;
+        m_mailbox_full = true;
+    }
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+    m_stats.received++;
+    if (coalesced) {
+        m_stats.coalesced++;
+    }
+}
+
+bool MobileBaseVelocityControl_nws_ros::applyCommand(const VelocityCommand& cmd)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_iNavVel == nullptr)
+    {
+        yCErrorThrottle(MOBVEL_NWS_ROS, watchdog_warning_period, "Subdevice interface not yet initialized");
+        return false;
+    }
+    return m_iNavVel->applyVelocityCommand(cmd.x_vel, cmd.y_vel, cmd.theta_vel);
+}
+
+void MobileBaseVelocityControl_nws_ros::run()
+{
+    VelocityCommand cmd;
+    bool has_command = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mailbox_mutex);
+        if (m_mailbox_full)
+        {
+            cmd = m_mailbox;
+            m_mailbox_full = false;
+            has_command = true;
+        }
+    }
+
+    double now = SystemClock::nowSystem();
+    if (has_command)
+    {
+        m_last_command_time = cmd.received_time;
+        m_stopped = (cmd.x_vel == 0 && cmd.y_vel == 0 && cmd.theta_vel == 0);
+        if (applyCommand(cmd))
+        {
+            now = SystemClock::nowSystem();
+            double latency = now - cmd.received_time;
+            if (!m_latency_topic_name.empty())
+            {
+                yarp::rosmsg::std_msgs::Float64& msg = m_latency_publisher.prepare();
+                msg.data = latency;
+                m_latency_publisher.write();
+            }
+            std::lock_guard<std::mutex> lock(m_stats_mutex);
+            m_stats.applied++;
+            m_stats.mean += (latency - m_stats.mean) / m_stats.applied;
+            m_stats.max = std::max(m_stats.max, latency);
+        }
+    }
+    else if (m_watchdog_timeout > 0 && !m_stopped && now - m_last_command_time > m_watchdog_timeout)
+    {
+        // Until the base is stopped the command is retried at every period, but not the warning
+        if (now - m_last_watchdog_warning_time >= watchdog_warning_period)
+        {
+            yCWarning(MOBVEL_NWS_ROS) << "No command received for" << now - m_last_command_time << "s, stopping the base";
+            m_last_watchdog_warning_time = now;
+        }
+        if (applyCommand(VelocityCommand()))
+        {
+            m_stopped = true;
+            m_last_watchdog_warning_time = 0.0;
+            std::lock_guard<std::mutex> lock(m_stats_mutex);
+            m_stats.watchdog_stops++;
+        }
+    }
+
+    if (m_stats_report_period > 0.0 && now - m_last_report_time >= m_stats_report_period)
+    {
+        std::lock_guard<std::mutex> lock(m_stats_mutex);
+        if (m_last_report_time > 0.0)
+        {
+            yCInfo(MOBVEL_NWS_ROS,
+                   "<%s>: %zu commands received, %zu applied, %zu coalesced, %zu watchdog stops, latency %.3f ms (max %.3f ms)",
+                   m_ros_topic_name.c_str(),
+                   m_stats.received,
+                   m_stats.applied,
+                   m_stats.coalesced,
+                   m_stats.watchdog_stops,
+                   m_stats.mean * 1000.0,
+                   m_stats.max * 1000.0);
+            m_stats = LatencyStatistics();
+        }
+        m_last_report_time = now;
+    }
+}
+
+MobileBaseVelocityControl_nws_ros::LatencyStatistics MobileBaseVelocityControl_nws_ros::getLatencyStatistics() const
+{
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+    return m_stats;
+}
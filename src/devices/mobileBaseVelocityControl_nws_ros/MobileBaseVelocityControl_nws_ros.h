@@ -12,25 +12,30 @@
 #include <yarp/sig/Vector.h>
 #include <yarp/os/Time.h>
 #include <yarp/os/Subscriber.h>
+#include <yarp/os/Publisher.h>
 #include <yarp/dev/PolyDriver.h>
 #include <yarp/dev/INavigation2D.h>
 #include <yarp/os/Node.h>
+#include <yarp/os/PeriodicThread.h>
 #include <yarp/rosmsg/geometry_msgs/Twist.h>
+#include <yarp/rosmsg/std_msgs/Float64.h>
 #include <yarp/dev/WrapperSingle.h>
 
 #include <mutex>
 #include <string>
 
+class MobileBaseVelocityControl_nws_ros;
+
 class commandSubscriber :
     public yarp::os::Subscriber<yarp::rosmsg::geometry_msgs::Twist>
 {
     public:
-    void init(yarp::dev::Nav2D::INavigation2DVelocityActions* m_iNavVel);
+    void init(MobileBaseVelocityControl_nws_ros* owner);
     void deinit();
 
     ~commandSubscriber ();
     commandSubscriber ();
-    yarp::dev::Nav2D::INavigation2DVelocityActions* m_iNavVel = nullptr;
+    MobileBaseVelocityControl_nws_ros* m_owner = nullptr;
 
     using yarp::os::Subscriber<yarp::rosmsg::geometry_msgs::Twist>::onRead;
     virtual void onRead (yarp::rosmsg::geometry_msgs::Twist& v) override;
@@ -49,12 +54,37 @@ class commandSubscriber :
  * |:--------------:|:--------------:|:-------:|:--------------:|:------------------------------:|:------------:|:-----------------------------------------------------------------:|:-----:|
  * | node_name      |      -         | string  | -              | /mobileBase_VelControl_nws_ros | No           | Full name of the opened ROS node                                  |       |
  * | topic_name     |     -          | string  | -              | /velocity_input                | No           | Full name of the opened ROS topic                                 |       |
+ * | max_rate       |     -          | double  | Hz             | 0                              | No           | Maximum rate of the commands sent to the attached device          | 0 applies each command as it is received, see below |
+ * | watchdog_timeout |   -          | double  | s              | 0                              | No           | A zero velocity is commanded if no command is received for this time | only with max_rate, 0 disables it |
+ * | stats_report_period | -         | double  | s              | 5.0                            | No           | Period of the latency statistics printed with max_rate            | 0 disables the report |
+ * | latency_topic_name |  -          | string  | -              | -                              | No           | If set, the latency of each applied command is published on this topic as std_msgs/Float64, in s | only with max_rate, must start with a leading '/' |
+ *
+ * By default each received command is applied from the subscriber callback, so when the attached device is
+ * remote a burst of commands queues up as many rpc calls.
+ * With `max_rate` greater than 0, the callback only stores the last received command, and a thread applies it
+ * at most `max_rate` times per second: the commands received in between are discarded, the latest one wins.
+ * The same thread stops the base when no command is received for `watchdog_timeout` seconds, and measures
+ * the latency between the reception of a command and the return of applyVelocityCommand().
+ * While the base cannot be stopped (e.g. no device is attached) the watchdog retries at every period, and
+ * warns at most once every few seconds.
  */
 
 class MobileBaseVelocityControl_nws_ros :
     public yarp::dev::DeviceDriver,
-    public yarp::dev::WrapperSingle
+    public yarp::dev::WrapperSingle,
+    public yarp::os::PeriodicThread
 {
+public:
+    struct LatencyStatistics
+    {
+        size_t received {0};       // commands received from the topic
+        size_t applied {0};        // commands sent to the attached device
+        size_t coalesced {0};      // commands replaced by a newer one before being applied
+        size_t watchdog_stops {0}; // zero velocities commanded by the watchdog
+        double mean {0.0};         // s
+        double max {0.0};          // s
+    };
+
 protected:
     std::string                   m_ros_node_name = "/mobileBase_VelControl_nws_ros";
     std::string                   m_ros_topic_name = "/velocity_input";
@@ -63,14 +93,53 @@ protected:
 
     yarp::dev::PolyDriver         m_subdev;
 
+    std::mutex                                      m_mutex;
+    yarp::dev::Nav2D::INavigation2DVelocityActions* m_iNavVel = nullptr;
+
+    double                        m_max_rate = 0.0;
+    double                        m_watchdog_timeout = 0.0;
+    double                        m_stats_report_period = 5.0;
+    std::string                   m_latency_topic_name;
+    yarp::os::Publisher<yarp::rosmsg::std_msgs::Float64> m_latency_publisher;
+
+    // The last received command, waiting to be applied by the thread
+    struct VelocityCommand
+    {
+        double x_vel {0.0};
+        double y_vel {0.0};
+        double theta_vel {0.0};
+        double received_time {0.0};
+    };
+    std::mutex                    m_mailbox_mutex;
+    VelocityCommand               m_mailbox;
+    bool                          m_mailbox_full = false;
+
+    // Only used by the thread
+    double                        m_last_command_time = 0.0;
+    bool                          m_stopped = true;
+    double                        m_last_report_time = 0.0;
+    double                        m_last_watchdog_warning_time = 0.0;
+    static constexpr double       watchdog_warning_period = 5.0; // s
+
+    mutable std::mutex            m_stats_mutex;
+    LatencyStatistics             m_stats;
+
+    bool applyCommand(const VelocityCommand& cmd);
+
 public:
     virtual ~MobileBaseVelocityControl_nws_ros () {};
-    MobileBaseVelocityControl_nws_ros() {};
+    MobileBaseVelocityControl_nws_ros() : PeriodicThread(0.01) {};
 
     /* DeviceDriver methods */
     bool open(yarp::os::Searchable& config) override;
     bool close() override;
 
+    /* PeriodicThread methods */
+    void run() override;
+
+    void commandReceived(const yarp::rosmsg::geometry_msgs::Twist& v);
+    LatencyStatistics getLatencyStatistics() const;
+
 private:
     bool detach() override;
     bool attach(yarp::dev::PolyDriver* driver) override;
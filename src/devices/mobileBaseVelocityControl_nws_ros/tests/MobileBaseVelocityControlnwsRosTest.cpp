@@ -0,0 +1,213 @@
+/*
+ * SPDX-FileCopyrightText: 2006-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "MobileBaseVelocityControl_nws_ros.h"
+
+#include <yarp/os/LogStream.h>
+#include <yarp/os/Network.h>
+#include <yarp/os/Node.h>
+#include <yarp/os/Property.h>
+#include <yarp/os/Subscriber.h>
+#include <yarp/os/SystemClock.h>
+#include <yarp/os/Time.h>
+
+#include <mutex>
+
+#include <catch2/catch_amalgamated.hpp>
+#include <harness.h>
+
+using namespace yarp::os;
+using yarp::dev::Nav2D::INavigation2DVelocityActions;
+
+namespace {
+// A navigation device whose commands take as long as a remote call
+class SlowNavigation : public INavigation2DVelocityActions
+{
+public:
+    double delay = 0.005;
+
+    bool applyVelocityCommand(double x_vel, double y_vel, double theta_vel, double timeout = 0.1) override
+    {
+        yarp::os::SystemClock::delaySystem(delay);
+        std::lock_guard<std::mutex> lock(mutex);
+        applied++;
+        last_x = x_vel;
+        last_y = y_vel;
+        last_theta = theta_vel;
+        return true;
+    }
+
+    bool getLastVelocityCommand(double& x_vel, double& y_vel, double& theta_vel) override
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        x_vel = last_x;
+        y_vel = last_y;
+        theta_vel = last_theta;
+        return true;
+    }
+
+    size_t getApplied()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return applied;
+    }
+
+private:
+    std::mutex mutex;
+    size_t applied = 0;
+    double last_x = 0;
+    double last_y = 0;
+    double last_theta = 0;
+};
+
+// Attaches the interface directly, without a PolyDriver
+class TestVelocityControl : public MobileBaseVelocityControl_nws_ros
+{
+public:
+    void attachNavigation(INavigation2DVelocityActions* iNavVel)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_iNavVel = iNavVel;
+    }
+};
+
+yarp::rosmsg::geometry_msgs::Twist makeTwist(double x)
+{
+    yarp::rosmsg::geometry_msgs::Twist v;
+    v.linear.x = x;
+    v.linear.y = 0.1;
+    v.angular.z = 0.2;
+    return v;
+}
+} // namespace
+
+TEST_CASE("dev::mobileBaseVelocityControl_nws_ros_Test", "[yarp::dev]")
+{
+    Network::setLocalMode(true);
+
+    SECTION("A burst of commands, applied synchronously and coalesced")
+    {
+        constexpr size_t commands = 100;
+
+        // Each command is applied from the callback
+        SlowNavigation syncNav;
+        TestVelocityControl syncNws;
+        {
+            Property p_cfg;
+            p_cfg.put("node_name", "/mobileBaseVelocityControl_nws_ros_test");
+            p_cfg.put("topic_name", "/velocity_input");
+            REQUIRE(syncNws.open(p_cfg));
+        }
+        syncNws.attachNavigation(&syncNav);
+        double start = SystemClock::nowSystem();
+        for (size_t i = 0; i < commands; i++) {
+            syncNws.commandReceived(makeTwist(static_cast<double>(i)));
+        }
+        double syncTime = SystemClock::nowSystem() - start;
+        CHECK(syncNav.getApplied() == commands);
+        CHECK(syncNws.close());
+
+        // Only the latest command is applied, at most 50 times per second
+        SlowNavigation nav;
+        TestVelocityControl nws;
+        {
+            Property p_cfg;
+            p_cfg.put("node_name", "/mobileBaseVelocityControl_nws_ros_test");
+            p_cfg.put("topic_name", "/velocity_input");
+            p_cfg.put("max_rate", 50.0);
+            p_cfg.put("watchdog_timeout", 0.2);
+            p_cfg.put("stats_report_period", 0.0);
+            REQUIRE(nws.open(p_cfg));
+        }
+        nws.attachNavigation(&nav);
+        start = SystemClock::nowSystem();
+        for (size_t i = 0; i < commands; i++) {
+            nws.commandReceived(makeTwist(static_cast<double>(i)));
+        }
+        double coalescedTime = SystemClock::nowSystem() - start;
+        yInfo() << commands << "commands received in" << syncTime << "s when applied synchronously,"
+                << coalescedTime << "s when coalesced";
+        CHECK(coalescedTime < syncTime);
+
+        // The thread applies the last command
+        yarp::os::Time::delay(0.1);
+        double x = 0;
+        double y = 0;
+        double theta = 0;
+        nav.getLastVelocityCommand(x, y, theta);
+        CHECK(x == static_cast<double>(commands - 1));
+        CHECK(y == 0.1);
+        MobileBaseVelocityControl_nws_ros::LatencyStatistics stats = nws.getLatencyStatistics();
+        CHECK(stats.received == commands);
+        CHECK(stats.applied == nav.getApplied());
+        CHECK(stats.applied < commands);
+        CHECK(stats.applied + stats.coalesced == commands);
+        CHECK(stats.mean <= stats.max);
+        INFO("latency " << stats.mean << " s, max " << stats.max << " s");
+
+        // The watchdog stops the base once
+        yarp::os::Time::delay(0.5);
+        nav.getLastVelocityCommand(x, y, theta);
+        CHECK(x == 0);
+        CHECK(y == 0);
+        CHECK(theta == 0);
+        stats = nws.getLatencyStatistics();
+        CHECK(stats.watchdog_stops == 1);
+        CHECK(nav.getApplied() == stats.applied + 1);
+
+        CHECK(nws.close());
+    }
+
+    SECTION("Latency published on a topic, watchdog without a device")
+    {
+        SlowNavigation nav;
+        TestVelocityControl nws;
+        {
+            Property p_cfg;
+            p_cfg.put("node_name", "/mobileBaseVelocityControl_nws_ros_test");
+            p_cfg.put("topic_name", "/velocity_input");
+            p_cfg.put("max_rate", 50.0);
+            p_cfg.put("watchdog_timeout", 0.1);
+            p_cfg.put("stats_report_period", 0.0);
+            p_cfg.put("latency_topic_name", "/velocity_latency");
+            REQUIRE(nws.open(p_cfg));
+        }
+
+        Node node("/mobileBaseVelocityControl_nws_ros_test_reader");
+        Subscriber<yarp::rosmsg::std_msgs::Float64> reader;
+        REQUIRE(reader.topic("/velocity_latency"));
+
+        // Each applied command publishes its latency
+        nws.attachNavigation(&nav);
+        yarp::rosmsg::std_msgs::Float64* latency = nullptr;
+        for (int i = 0; i < 100 && latency == nullptr; i++) {
+            nws.commandReceived(makeTwist(1.0));
+            yarp::os::Time::delay(0.02);
+            latency = reader.read(false);
+        }
+        REQUIRE(latency != nullptr);
+        CHECK(latency->data >= 0.0);
+        CHECK(latency->data <= nws.getLatencyStatistics().max);
+
+        // Without a device the watchdog cannot stop the base, and keeps retrying
+        nws.attachNavigation(nullptr);
+        nws.commandReceived(makeTwist(1.0));
+        yarp::os::Time::delay(0.5);
+        CHECK(nws.getLatencyStatistics().watchdog_stops == 0);
+        nws.attachNavigation(&nav);
+        yarp::os::Time::delay(0.1);
+        CHECK(nws.getLatencyStatistics().watchdog_stops == 1);
+        double x = 1;
+        double y = 1;
+        double theta = 1;
+        nav.getLastVelocityCommand(x, y, theta);
+        CHECK(x == 0);
+
+        reader.close();
+        CHECK(nws.close());
+    }
+
+    Network::setLocalMode(false);
+}
@@ -10,6 +10,7 @@
 #include <yarp/os/PeriodicThread.h>
 #include <yarp/os/Publisher.h>
 #include <yarp/os/Node.h>
+#include <yarp/os/Value.h>
 #include <yarp/dev/DeviceDriver.h>
 #include <yarp/dev/IMultipleWrapper.h>
 #include <yarp/dev/MultipleAnalogSensorsInterfaces.h>
@@ -17,6 +18,18 @@
 #include <yarp/os/LogComponent.h>
 #include <yarp/os/LogStream.h>
 
+#include <RosNodeRegistry.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
 
 // The log component is defined in each device, with a specialized name
 YARP_DECLARE_LOG_COMPONENT(GENERICSENSORROSPUBLISHER)
@@ -37,6 +50,34 @@ YARP_DECLARE_LOG_COMPONENT(GENERICSENSORROSPUBLISHER)
  * | topic          |      -         | string  | -              |   -              | Yes                         | The name of the ROS topic opened by this device.                  | MUST start with a '/' character |
  * | node_name      |      -         | string  | -              | $topic + "_node" | No                          | The name of the ROS node opened by this device                    | Autogenerated by default |
  * | period         |      -         | double  | s              |   -              | Yes                         | Refresh period of the broadcasted values in seconds               |  |
+ * | shared_node    |      -         | bool    | -              |   false          | No                          | Share the ROS node with the other devices of the process declaring the same node_name | the devices of other plugin libraries are included only on some platforms, see RosNodeRegistry |
+ * | all_sensors    |      -         | bool    | -              |   false          | No                          | Publish all the sensors of the attached device, not only the first one | see below |
+ * | async_registration | -          | bool    | -              |   false          | No                          | Register the node and the topic on the ROS network in background  | see below |
+ * | skip_duplicates |     -         | bool    | -              |   false          | No                          | Publish a sensor only when its timestamp has advanced             | see below |
+ * | sensor_period  |      -         | double  | s              |   0              | No                          | Nominal period of the sensor, used to count the dropped samples   | see below |
+ *
+ * By default only the first sensor of the attached device is published, on `topic`.
+ * If `all_sensors` is true, every sensor of the wrapped type is published on its own topic, named
+ * `topic` + "/" + the frame name of the sensor (characters not allowed in ROS names are replaced with '_',
+ * leading '/' are removed). A sensor without a frame name cannot be published, and the attach fails. When
+ * two sensors end up with the same topic, the index of the second one is appended to its topic ("_" + index).
+ * All the sensors are read in the same cycle of the thread, before any message is sent.
+ *
+ * If `async_registration` is true, open() returns as soon as the parameters are checked, while the node
+ * and the topic are registered by a background thread: when many devices are opened in a row, their
+ * registrations run in parallel. attachAll() waits for the registration to complete before starting to
+ * publish, and fails if the registration failed: when all the devices are opened before being attached
+ * (as yarprobotinterface does), the attachAll() calls together wait for the slowest registration, not for
+ * the sum of all of them.
+ *
+ * The thread reads each sensor once per `period`, regardless of the rate of the sensor: a sample read
+ * twice (same timestamp) is a duplicated sample, while a sample produced and overwritten between two reads
+ * is a dropped one. Dropped samples are computed from `sensor_period` if it is set, otherwise from the
+ * smallest increment of the sensor timestamp observed so far (in this case a sensor constantly faster than
+ * the thread cannot be detected, only the gaps in its timestamps). Both are counted, see getSampleStatistics(), and reported on detach: they can be used to
+ * choose a `period` matching the actual rate of the sensor. If `skip_duplicates` is true, duplicated
+ * samples are not published.
+ * The failed reads of the sensors are counted as well, and reported with an error at most once per second.
  */
 
 template <class ROS_MSG>
@@ -46,18 +87,47 @@ class GenericSensorRosPublisher :
         public yarp::dev::IMultipleWrapper
 {
 protected:
+    struct SensorOutput
+    {
+        size_t      sens_index{0};
+        std::string framename;
+        std::string topic;
+        std::unique_ptr<yarp::os::Publisher<ROS_MSG>> publisher;
+        size_t      msg_counter{0};
+        double      timestamp{0};
+        bool        ready{false};
+        bool        has_sample{false};    // last_timestamp is valid
+        double      last_timestamp{0};
+        double      sensor_period{0};     // sensor_period parameter, or smallest increment of the timestamp observed
+    };
+
     double            m_periodInS{0.01};
     std::string       m_publisherName;
     std::string       m_rosNodeName;
     yarp::os::Node*   m_rosNode;
-    yarp::os::Publisher<ROS_MSG> m_publisher;
+    bool              m_sharedNode{false}; // node obtained from yarp::dev::RosNodeRegistry
     yarp::dev::PolyDriver* m_poly;
-    size_t                 m_msg_counter;
-    double                 m_timestamp;
-    std::string            m_framename;
-    const size_t           m_sens_index = 0;
+    bool              m_allSensors{false};
+    std::vector<SensorOutput> m_outputs; // the first one is opened in open(), the others in attachAll()
+    bool              m_asyncRegistration{false};
+    std::thread       m_registrationThread;
+    std::atomic<bool> m_registrationOk{false};
+    bool              m_skipDuplicates{false};
+    double            m_sensorPeriod{0};
+    std::atomic<size_t> m_publishedSamples{0};
+    std::atomic<size_t> m_duplicatedSamples{0};
+    std::atomic<size_t> m_droppedSamples{0};
+    std::atomic<size_t> m_failedReads{0};
 
 public:
+    struct SampleStatistics
+    {
+        size_t published{0};
+        size_t duplicated{0};
+        size_t dropped{0};
+        size_t failed{0}; // reads of a sensor that failed, nothing is published for them
+    };
+
     GenericSensorRosPublisher();
     virtual ~GenericSensorRosPublisher();
 
@@ -73,8 +143,47 @@ public:
     void threadRelease() override;
     void run() override;
 
+    /**
+     * Waits until the node and the topic opened by open() are registered.
+     * @return true if the registration succeeded
+     */
+    bool waitForRegistration();
+
+    /**
+     * Samples published, read more than once and never read, and failed reads, summed over all
+     * the sensors, since the last attach.
+     */
+    SampleStatistics getSampleStatistics() const;
+
 protected:
     virtual bool viewInterfaces() = 0;
+
+    /**
+     * Number of sensors of the wrapped type available in the attached device.
+     */
+    virtual size_t getNrOfSensors() const = 0;
+
+    /**
+     * Frame name of the sensor with the given index.
+     */
+    virtual bool getSensorFrameName(size_t sens_index, std::string& framename) const = 0;
+
+    /**
+     * Reads the sensor with the given index and fills the message, except the header.
+     * @return false if the measure is not available, the message is not published in this case
+     */
+    virtual bool readSensor(size_t sens_index, ROS_MSG& msg, double& timestamp) = 0;
+
+private:
+    std::string topicOnNode(const std::string& topic) const
+    {
+        // In async mode other nodes may be created concurrently, so the topic is always bound explicitly
+        return (m_sharedNode || m_asyncRegistration) ? yarp::dev::RosNodeRegistry::topicOnNode(topic, m_rosNodeName) : topic;
+    }
+    bool registerOnRos();
+    bool checkNewSample(SensorOutput& out);
+    bool openOutputs();
+    void closeOutputs();
 };
 
 template <class ROS_MSG>
@@ -83,12 +192,15 @@ GenericSensorRosPublisher<ROS_MSG>::GenericSensorRosPublisher() :
 {
     m_rosNode = nullptr;
     m_poly = nullptr;
-    m_msg_counter=0;
-    m_timestamp=0;
 }
 
 template <class ROS_MSG>
-GenericSensorRosPublisher<ROS_MSG>::~GenericSensorRosPublisher() = default;
+GenericSensorRosPublisher<ROS_MSG>::~GenericSensorRosPublisher()
+{
+    if (m_registrationThread.joinable()) {
+        m_registrationThread.join();
+    }
+}
 
 template <class ROS_MSG>
 bool GenericSensorRosPublisher<ROS_MSG>::open(yarp::os::Searchable & config)
@@ -134,14 +246,45 @@ bool GenericSensorRosPublisher<ROS_MSG>::open(yarp::os::Searchable & config)
         return false;
     }
 
-    m_rosNode = new yarp::os::Node(m_rosNodeName); // add a ROS node
+    m_sharedNode = config.check("shared_node", yarp::os::Value(false)).asBool();
+    m_allSensors = config.check("all_sensors", yarp::os::Value(false)).asBool();
+    m_asyncRegistration = config.check("async_registration", yarp::os::Value(false)).asBool();
+    m_skipDuplicates = config.check("skip_duplicates", yarp::os::Value(false)).asBool();
+    m_sensorPeriod = config.check("sensor_period", yarp::os::Value(0.0)).asFloat64();
+    if (m_sensorPeriod < 0) {
+        yCError(GENERICSENSORROSPUBLISHER, "`sensor_period` parameter (%f) must not be negative, exiting.", m_sensorPeriod);
+        return false;
+    }
+
+    if (m_asyncRegistration) {
+        m_registrationOk = false;
+        m_registrationThread = std::thread([this]() { m_registrationOk = registerOnRos(); });
+        return true;
+    }
+
+    m_registrationOk = registerOnRos();
+    return m_registrationOk;
+}
+
+template <class ROS_MSG>
+bool GenericSensorRosPublisher<ROS_MSG>::registerOnRos()
+{
+    if (m_sharedNode) {
+        m_rosNode = yarp::dev::RosNodeRegistry::acquire(m_rosNodeName);
+    } else {
+        m_rosNode = new yarp::os::Node(m_rosNodeName); // add a ROS node
+    }
 
     if (m_rosNode == nullptr) {
         yCError(GENERICSENSORROSPUBLISHER) << "Opening " << m_rosNodeName << " Node, check your yarp-ROS network configuration\n";
         return false;
     }
 
-    if (!m_publisher.topic(m_publisherName)) {
+    // The topic of the first sensor is opened here, the others are known only at attach
+    m_outputs.resize(1);
+    m_outputs[0].topic = m_publisherName;
+    m_outputs[0].publisher = std::make_unique<yarp::os::Publisher<ROS_MSG>>();
+    if (!m_outputs[0].publisher->topic(topicOnNode(m_publisherName))) {
         yCError(GENERICSENSORROSPUBLISHER) << "Opening " << m_publisherName << " Topic, check your yarp-ROS network configuration\n";
         return false;
     }
@@ -149,17 +292,104 @@ bool GenericSensorRosPublisher<ROS_MSG>::open(yarp::os::Searchable & config)
     return true;
 }
 
+template <class ROS_MSG>
+bool GenericSensorRosPublisher<ROS_MSG>::waitForRegistration()
+{
+    if (m_registrationThread.joinable()) {
+        m_registrationThread.join();
+    }
+    return m_registrationOk;
+}
+
 template <class ROS_MSG>
 bool GenericSensorRosPublisher<ROS_MSG>::close()
 {
-    return this->detachAll();
+    bool ok = this->detachAll();
+
+    waitForRegistration();
 
-    m_publisher.close();
+    closeOutputs();
+    m_outputs.clear();
     if (m_rosNode)
     {
-        delete m_rosNode;
+        if (m_sharedNode) {
+            yarp::dev::RosNodeRegistry::release(m_rosNode);
+        } else {
+            delete m_rosNode;
+        }
         m_rosNode = nullptr;
     }
+    return ok;
+}
+
+template <class ROS_MSG>
+bool GenericSensorRosPublisher<ROS_MSG>::openOutputs()
+{
+    if (m_outputs.empty()) {
+        yCError(GENERICSENSORROSPUBLISHER, "The device has not been opened.");
+        return false;
+    }
+
+    size_t nrOfSensors = getNrOfSensors();
+    if (nrOfSensors == 0) {
+        yCError(GENERICSENSORROSPUBLISHER, "The attached device has no sensors of the wrapped type.");
+        return false;
+    }
+
+    if (!m_allSensors) {
+        m_outputs[0].sens_index = 0;
+        return getSensorFrameName(0, m_outputs[0].framename);
+    }
+
+    // In all_sensors mode the topic opened in open() is replaced by one topic per sensor
+    closeOutputs();
+    m_outputs.clear();
+    m_outputs.resize(nrOfSensors);
+    std::set<std::string> topics;
+    for (size_t i = 0; i < nrOfSensors; i++)
+    {
+        SensorOutput& out = m_outputs[i];
+        out.sens_index = i;
+        if (!getSensorFrameName(i, out.framename)) {
+            yCError(GENERICSENSORROSPUBLISHER, "Unable to get the frame name of sensor %zu.", i);
+            return false;
+        }
+        std::string suffix = out.framename.substr(std::min(out.framename.find_first_not_of('/'), out.framename.size()));
+        if (suffix.empty()) {
+            yCError(GENERICSENSORROSPUBLISHER, "Sensor %zu has no frame name, its topic cannot be named.", i);
+            return false;
+        }
+        for (auto& c : suffix) {
+            if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_' && c != '/') {
+                c = '_';
+            }
+        }
+        out.topic = m_publisherName + "/" + suffix;
+        if (topics.count(out.topic) != 0) {
+            out.topic += "_" + std::to_string(i);
+            yCWarning(GENERICSENSORROSPUBLISHER) << "The frame name of sensor" << i << "(" << out.framename << ") is already used, publishing it on" << out.topic;
+        }
+        if (!topics.insert(out.topic).second) {
+            yCError(GENERICSENSORROSPUBLISHER) << "Topic" << out.topic << "of sensor" << i << "is already used.";
+            return false;
+        }
+        out.publisher = std::make_unique<yarp::os::Publisher<ROS_MSG>>();
+        if (!out.publisher->topic(topicOnNode(out.topic))) {
+            yCError(GENERICSENSORROSPUBLISHER) << "Opening " << out.topic << " Topic, check your yarp-ROS network configuration\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+template <class ROS_MSG>
+void GenericSensorRosPublisher<ROS_MSG>::closeOutputs()
+{
+    for (auto& out : m_outputs) {
+        if (out.publisher) {
+            out.publisher->close();
+        }
+    }
 }
 
 template <class ROS_MSG>
@@ -190,6 +420,12 @@ bool GenericSensorRosPublisher<ROS_MSG>::attachAll(const yarp::dev::PolyDriverLi
         return false;
     }
 
+    if (!waitForRegistration())
+    {
+        yCError(GENERICSENSORROSPUBLISHER, "Registration of the ROS node and topic failed.");
+        return false;
+    }
+
     // View all the interfaces
     bool ok = viewInterfaces();
     if (!ok)
@@ -198,6 +434,22 @@ bool GenericSensorRosPublisher<ROS_MSG>::attachAll(const yarp::dev::PolyDriverLi
         return false;
     }
 
+    ok = openOutputs();
+    if (!ok)
+    {
+        yCError(GENERICSENSORROSPUBLISHER, "Unable to setup the published sensors.");
+        return false;
+    }
+
+    for (auto& out : m_outputs) {
+        out.has_sample = false;
+        out.sensor_period = m_sensorPeriod;
+    }
+    m_publishedSamples = 0;
+    m_duplicatedSamples = 0;
+    m_droppedSamples = 0;
+    m_failedReads = 0;
+
     // Set rate period
     ok &= this->setPeriod(m_periodInS);
     ok &= this->start();
@@ -211,13 +463,86 @@ bool GenericSensorRosPublisher<ROS_MSG>::detachAll()
     // Stop the thread on detach
     if (this->isRunning()) {
         this->stop();
+        SampleStatistics stats = getSampleStatistics();
+        yCInfo(GENERICSENSORROSPUBLISHER, "%s: %zu samples published, %zu duplicated, %zu dropped, %zu failed reads",
+               m_publisherName.c_str(), stats.published, stats.duplicated, stats.dropped, stats.failed);
+    }
+    return true;
+}
+
+template <class ROS_MSG>
+typename GenericSensorRosPublisher<ROS_MSG>::SampleStatistics GenericSensorRosPublisher<ROS_MSG>::getSampleStatistics() const
+{
+    SampleStatistics stats;
+    stats.published = m_publishedSamples;
+    stats.duplicated = m_duplicatedSamples;
+    stats.dropped = m_droppedSamples;
+    stats.failed = m_failedReads;
+    return stats;
+}
+
+template <class ROS_MSG>
+bool GenericSensorRosPublisher<ROS_MSG>::checkNewSample(SensorOutput& out)
+{
+    if (!out.has_sample) {
+        out.has_sample = true;
+        out.last_timestamp = out.timestamp;
+        return true;
+    }
+
+    double dt = out.timestamp - out.last_timestamp;
+    if (dt <= 0) {
+        m_duplicatedSamples++;
+        return false;
+    }
+
+    if (out.sensor_period <= 0 || (m_sensorPeriod <= 0 && dt < out.sensor_period)) {
+        out.sensor_period = dt;
+    } else {
+        long samples = std::lround(dt / out.sensor_period);
+        if (samples > 1) {
+            m_droppedSamples += static_cast<size_t>(samples - 1);
+        }
     }
+    out.last_timestamp = out.timestamp;
     return true;
 }
 
 template <class ROS_MSG>
 void GenericSensorRosPublisher<ROS_MSG>::run()
 {
+    // All the sensors are read before sending any message
+    for (auto& out : m_outputs)
+    {
+        out.ready = false;
+        if (!out.publisher || !out.publisher->asPort().isOpen()) {
+            continue;
+        }
+        ROS_MSG& msg = out.publisher->prepare();
+        out.ready = readSensor(out.sens_index, msg, out.timestamp);
+        if (!out.ready) {
+            m_failedReads++;
+            yCErrorThrottle(GENERICSENSORROSPUBLISHER, 1.0, "%s: unable to read sensor %zu (%zu failed reads since the attach).",
+                            out.topic.c_str(), out.sens_index, static_cast<size_t>(m_failedReads));
+        } else if (!checkNewSample(out) && m_skipDuplicates) {
+            out.ready = false;
+        }
+        if (!out.ready) {
+            out.publisher->unprepare();
+            continue;
+        }
+        msg.header.frame_id = out.framename;
+        msg.header.seq = out.msg_counter++;
+        msg.header.stamp = out.timestamp;
+    }
+
+    for (auto& out : m_outputs)
+    {
+        if (out.ready) {
+            out.publisher->write();
+            m_publishedSamples++;
+        }
+    }
 }
 
 template <class ROS_MSG>
@@ -4,8 +4,9 @@
  */
 
 #include "IMURosPublisher.h"
-#include "Yarp/math/Quaternion.h"
-#include "Yarp/math/Math.h"
+
+#include <algorithm>
+#include <cmath>
 
 #ifndef M_PI
 #define M_PI (3.14159265358979323846)
@@ -38,42 +39,60 @@ bool IMURosPublisher::viewInterfaces()
         return false;
     }
 
-    ok = m_iThreeAxisGyroscopes->getThreeAxisGyroscopeFrameName(m_sens_index, m_framename);
-    return ok;
+    return true;
+}
+
+void IMURosPublisher::rpyToQuaternion(double roll, double pitch, double yaw, yarp::rosmsg::geometry_msgs::Quaternion& q)
+{
+    double cr = cos(roll * 0.5);
+    double sr = sin(roll * 0.5);
+    double cp = cos(pitch * 0.5);
+    double sp = sin(pitch * 0.5);
+    double cy = cos(yaw * 0.5);
+    double sy = sin(yaw * 0.5);
+    q.w = cr * cp * cy + sr * sp * sy;
+    q.x = sr * cp * cy - cr * sp * sy;
+    q.y = cr * sp * cy + sr * cp * sy;
+    q.z = cr * cp * sy - sr * sp * cy;
+}
+
+size_t IMURosPublisher::getNrOfSensors() const
+{
+    return std::min(m_iThreeAxisGyroscopes->getNrOfThreeAxisGyroscopes(),
+                    std::min(m_iThreeAxisLinearAccelerometers->getNrOfThreeAxisLinearAccelerometers(),
+                             m_iOrientationSensors->getNrOfOrientationSensors()));
 }
 
-void IMURosPublisher::run()
+bool IMURosPublisher::getSensorFrameName(size_t sens_index, std::string& framename) const
 {
-    if (m_publisher.asPort().isOpen())
-    {
-        yarp::sig::Vector vecgyr(3);
-        yarp::sig::Vector vecacc(3);
-        yarp::sig::Vector vecrpy(3);
-        yarp::rosmsg::sensor_msgs::Imu& imu_ros_data = m_publisher.prepare();
-        m_iThreeAxisGyroscopes->getThreeAxisGyroscopeMeasure(m_sens_index, vecgyr, m_timestamp);
-        m_iThreeAxisLinearAccelerometers->getThreeAxisLinearAccelerometerMeasure(m_sens_index, vecacc, m_timestamp);
-        m_iOrientationSensors->getOrientationSensorMeasureAsRollPitchYaw(m_sens_index, vecrpy, m_timestamp);
-        imu_ros_data.clear();
-        imu_ros_data.header.frame_id = m_framename;
-        imu_ros_data.header.seq = m_msg_counter++;
-        imu_ros_data.header.stamp = m_timestamp;
-        imu_ros_data.angular_velocity.x = vecgyr[0] * M_PI / 180.0;
-        imu_ros_data.angular_velocity.y = vecgyr[1] * M_PI / 180.0;
-        imu_ros_data.angular_velocity.z = vecgyr[2] * M_PI / 180.0;
-        imu_ros_data.linear_acceleration.x = vecacc[0];
-        imu_ros_data.linear_acceleration.y = vecacc[1];
-        imu_ros_data.linear_acceleration.z = vecacc[2];
-        vecrpy[0] = vecrpy[0] * M_PI / 180.0;
-        vecrpy[1] = vecrpy[1] * M_PI / 180.0;
-        vecrpy[2] = vecrpy[2] * M_PI / 180.0;
-        yarp::sig::Matrix matrix = yarp::math::rpy2dcm(vecrpy);
-        yarp::math::Quaternion q; q.fromRotationMatrix(matrix);
-        imu_ros_data.orientation.x = q.x();
-        imu_ros_data.orientation.y = q.y();
-        imu_ros_data.orientation.z = q.z();
-        imu_ros_data.orientation.w = q.w();
+    return m_iThreeAxisGyroscopes->getThreeAxisGyroscopeFrameName(sens_index, framename);
+}
 
-        //imu_ros_data.orientation_covariance = 0;
-        m_publisher.write();
+bool IMURosPublisher::readSensor(size_t sens_index, yarp::rosmsg::sensor_msgs::Imu& imu_ros_data, double& timestamp)
+{
+    // All the measures are taken before filling the message, each one with its timestamp
+    double ts_gyr = 0;
+    double ts_acc = 0;
+    double ts_rpy = 0;
+    bool ok = m_iThreeAxisGyroscopes->getThreeAxisGyroscopeMeasure(sens_index, m_vecgyr, ts_gyr);
+    ok &= m_iThreeAxisLinearAccelerometers->getThreeAxisLinearAccelerometerMeasure(sens_index, m_vecacc, ts_acc);
+    ok &= m_iOrientationSensors->getOrientationSensorMeasureAsRollPitchYaw(sens_index, m_vecrpy, ts_rpy);
+    if (!ok) {
+        return false;
     }
- }
+    timestamp = std::max(ts_gyr, std::max(ts_acc, ts_rpy));
+
+    imu_ros_data.angular_velocity.x = m_vecgyr[0] * M_PI / 180.0;
+    imu_ros_data.angular_velocity.y = m_vecgyr[1] * M_PI / 180.0;
+    imu_ros_data.angular_velocity.z = m_vecgyr[2] * M_PI / 180.0;
+    imu_ros_data.linear_acceleration.x = m_vecacc[0];
+    imu_ros_data.linear_acceleration.y = m_vecacc[1];
+    imu_ros_data.linear_acceleration.z = m_vecacc[2];
+    rpyToQuaternion(m_vecrpy[0] * M_PI / 180.0,
+                    m_vecrpy[1] * M_PI / 180.0,
+                    m_vecrpy[2] * M_PI / 180.0,
+                    imu_ros_data.orientation);
+
+    //imu_ros_data.orientation_covariance = 0;
+    return true;
+}
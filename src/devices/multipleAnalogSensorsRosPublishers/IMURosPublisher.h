@@ -27,6 +27,10 @@
  * | topic          |      -         | string  | -              |   -              | Yes                         | The name of the ROS topic opened by this device.                  | MUST start with a '/' character |
  * | node_name      |      -         | string  | -              | $topic + "_node" | No                          | The name of the ROS node opened by this device                    | Autogenerated by default |
  * | period         |      -         | double  | s              |   -              | Yes                         | Refresh period of the broadcasted values in seconds               |  |
+ *
+ * The gyroscope, the accelerometer and the orientation sensor are read once per cycle, each one with its
+ * own timestamp; the message is stamped with the most recent of them, and it is not published if any of
+ * the readings fails.
  */
 class IMURosPublisher : public GenericSensorRosPublisher<yarp::rosmsg::sensor_msgs::Imu>
 {
@@ -36,6 +40,11 @@ class IMURosPublisher : public GenericSensorRosPublisher<yarp::rosmsg::sensor_ms
     yarp::dev::IOrientationSensors*            m_iOrientationSensors{ nullptr };
     yarp::dev::IThreeAxisMagnetometers*        m_iThreeAxisMagnetometers{ nullptr };
 
+    // Buffers reused at each cycle
+    yarp::sig::Vector m_vecgyr{ 3 };
+    yarp::sig::Vector m_vecacc{ 3 };
+    yarp::sig::Vector m_vecrpy{ 3 };
+
 public:
     using GenericSensorRosPublisher<yarp::rosmsg::sensor_msgs::Imu>::GenericSensorRosPublisher;
 
@@ -44,11 +53,17 @@ public:
     using GenericSensorRosPublisher<yarp::rosmsg::sensor_msgs::Imu>::attachAll;
     using GenericSensorRosPublisher<yarp::rosmsg::sensor_msgs::Imu>::detachAll;
 
-    /* PeriodicRateThread methods */
-    void run() override;
+    /**
+     * Closed form conversion of roll, pitch, yaw angles (in rad, R = Rz(yaw)*Ry(pitch)*Rx(roll),
+     * as in yarp::math::rpy2dcm) to a quaternion.
+     */
+    static void rpyToQuaternion(double roll, double pitch, double yaw, yarp::rosmsg::geometry_msgs::Quaternion& q);
 
 protected:
     bool viewInterfaces() override;
+    size_t getNrOfSensors() const override;
+    bool getSensorFrameName(size_t sens_index, std::string& framename) const override;
+    bool readSensor(size_t sens_index, yarp::rosmsg::sensor_msgs::Imu& msg, double& timestamp) override;
 };
 
 #endif
@@ -17,25 +17,28 @@ bool MagneticFieldRosPublisher::viewInterfaces()
         return false;
     }
 
-    ok = m_iThreeAxisMagnetometers->getThreeAxisMagnetometerFrameName(0, m_framename);
-    return ok;
+    return true;
 }
 
-void MagneticFieldRosPublisher::run()
+size_t MagneticFieldRosPublisher::getNrOfSensors() const
 {
-    if (m_publisher.asPort().isOpen())
-    {
-        yarp::sig::Vector vecmagn(3);
-        yarp::rosmsg::sensor_msgs::MagneticField& magfield_ros_data = m_publisher.prepare();
-        m_iThreeAxisMagnetometers->getThreeAxisMagnetometerMeasure(m_sens_index, vecmagn, m_timestamp);
-        magfield_ros_data.clear();
-        magfield_ros_data.header.frame_id = m_framename;;
-        magfield_ros_data.header.seq = m_msg_counter++;
-        magfield_ros_data.header.stamp = m_timestamp;
-        magfield_ros_data.magnetic_field.x = vecmagn[0];
-        magfield_ros_data.magnetic_field.y = vecmagn[1];
-        magfield_ros_data.magnetic_field.z = vecmagn[2];
-        //magfield_ros_data.magnetic_field_covariance = 0;
-        m_publisher.write();
+    return m_iThreeAxisMagnetometers->getNrOfThreeAxisMagnetometers();
+}
+
+bool MagneticFieldRosPublisher::getSensorFrameName(size_t sens_index, std::string& framename) const
+{
+    return m_iThreeAxisMagnetometers->getThreeAxisMagnetometerFrameName(sens_index, framename);
+}
+
+bool MagneticFieldRosPublisher::readSensor(size_t sens_index, yarp::rosmsg::sensor_msgs::MagneticField& magfield_ros_data, double& timestamp)
+{
+    yarp::sig::Vector vecmagn(3);
+    if (!m_iThreeAxisMagnetometers->getThreeAxisMagnetometerMeasure(sens_index, vecmagn, timestamp)) {
+        return false;
     }
- }
+    magfield_ros_data.magnetic_field.x = vecmagn[0];
+    magfield_ros_data.magnetic_field.y = vecmagn[1];
+    magfield_ros_data.magnetic_field.z = vecmagn[2];
+    //magfield_ros_data.magnetic_field_covariance = 0;
+    return true;
+}
@@ -41,11 +41,11 @@ public:
     using GenericSensorRosPublisher<yarp::rosmsg::sensor_msgs::MagneticField>::attachAll;
     using GenericSensorRosPublisher<yarp::rosmsg::sensor_msgs::MagneticField>::detachAll;
 
-    /* PeriodicRateThread methods */
-    void run() override;
-
 protected:
-    virtual bool viewInterfaces() override;
+    bool viewInterfaces() override;
+    size_t getNrOfSensors() const override;
+    bool getSensorFrameName(size_t sens_index, std::string& framename) const override;
+    bool readSensor(size_t sens_index, yarp::rosmsg::sensor_msgs::MagneticField& msg, double& timestamp) override;
 };
 
 #endif
@@ -7,6 +7,8 @@
 #include <yarp/sig/Matrix.h>
 #include <yarp/math/Math.h>
 
+#include <algorithm>
+
 #ifndef M_PI
 #define M_PI (3.14159265358979323846)
 #endif
@@ -27,36 +29,39 @@ bool PoseStampedRosPublisher::viewInterfaces()
         yCError(GENERICSENSORROSPUBLISHER) << "IPositionSensors interface is not available";
         return false;
     }
-    ok = m_iPositionSensors->getPositionSensorFrameName(m_sens_index, m_framename);
-    return ok;
+    return true;
+}
+
+size_t PoseStampedRosPublisher::getNrOfSensors() const
+{
+    return std::min(m_iPositionSensors->getNrOfPositionSensors(), m_iOrientationSensors->getNrOfOrientationSensors());
+}
+
+bool PoseStampedRosPublisher::getSensorFrameName(size_t sens_index, std::string& framename) const
+{
+    return m_iPositionSensors->getPositionSensorFrameName(sens_index, framename);
 }
 
-void PoseStampedRosPublisher::run()
+bool PoseStampedRosPublisher::readSensor(size_t sens_index, yarp::rosmsg::geometry_msgs::PoseStamped& pose_data, double& timestamp)
 {
-    if (m_publisher.asPort().isOpen())
-    {
-        yarp::sig::Vector vecpos(3);
-        yarp::sig::Vector vecrpy(3);
-        yarp::rosmsg::geometry_msgs::PoseStamped& pose_data = m_publisher.prepare();
-        m_iPositionSensors->getPositionSensorMeasure(m_sens_index, vecpos, m_timestamp);
-        m_iOrientationSensors->getOrientationSensorMeasureAsRollPitchYaw(m_sens_index, vecrpy, m_timestamp);
-        pose_data.clear();
-        pose_data.header.frame_id = m_framename;
-        pose_data.header.seq = m_msg_counter++;
-        pose_data.header.stamp = m_timestamp;
-        pose_data.pose.position.x = vecpos[0];
-        pose_data.pose.position.y = vecpos[1];
-        pose_data.pose.position.z = vecpos[2];
-        vecrpy[0] = vecrpy[0] * M_PI / 180.0;
-        vecrpy[1] = vecrpy[1] * M_PI / 180.0;
-        vecrpy[2] = vecrpy[2] * M_PI / 180.0;
-        yarp::sig::Matrix matrix = yarp::math::rpy2dcm(vecrpy);
-        yarp::math::Quaternion q; q.fromRotationMatrix(matrix);
-        pose_data.pose.orientation.x = q.x();
-        pose_data.pose.orientation.y = q.y();
-        pose_data.pose.orientation.z = q.z();
-        pose_data.pose.orientation.w = q.w();
-        //imu_ros_data.orientation_covariance = 0;
-        m_publisher.write();
+    yarp::sig::Vector vecpos(3);
+    yarp::sig::Vector vecrpy(3);
+    bool ok = m_iPositionSensors->getPositionSensorMeasure(sens_index, vecpos, timestamp);
+    ok &= m_iOrientationSensors->getOrientationSensorMeasureAsRollPitchYaw(sens_index, vecrpy, timestamp);
+    if (!ok) {
+        return false;
     }
- }
+    pose_data.pose.position.x = vecpos[0];
+    pose_data.pose.position.y = vecpos[1];
+    pose_data.pose.position.z = vecpos[2];
+    vecrpy[0] = vecrpy[0] * M_PI / 180.0;
+    vecrpy[1] = vecrpy[1] * M_PI / 180.0;
+    vecrpy[2] = vecrpy[2] * M_PI / 180.0;
+    yarp::sig::Matrix matrix = yarp::math::rpy2dcm(vecrpy);
+    yarp::math::Quaternion q; q.fromRotationMatrix(matrix);
+    pose_data.pose.orientation.x = q.x();
+    pose_data.pose.orientation.y = q.y();
+    pose_data.pose.orientation.z = q.z();
+    pose_data.pose.orientation.w = q.w();
+    return true;
+}
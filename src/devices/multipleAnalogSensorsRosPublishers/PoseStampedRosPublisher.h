@@ -41,11 +41,11 @@ public:
     using GenericSensorRosPublisher<yarp::rosmsg::geometry_msgs::PoseStamped>::attachAll;
     using GenericSensorRosPublisher<yarp::rosmsg::geometry_msgs::PoseStamped>::detachAll;
 
-    /* PeriodicRateThread methods */
-    void run() override;
-
 protected:
     bool viewInterfaces() override;
+    size_t getNrOfSensors() const override;
+    bool getSensorFrameName(size_t sens_index, std::string& framename) const override;
+    bool readSensor(size_t sens_index, yarp::rosmsg::geometry_msgs::PoseStamped& msg, double& timestamp) override;
 };
 
 #endif
@@ -17,24 +17,26 @@ bool TemperatureRosPublisher::viewInterfaces()
         return false;
     }
 
-    ok = m_ITemperature->getTemperatureSensorFrameName(0,m_framename);
-    return ok;
+    return true;
 }
 
-void TemperatureRosPublisher::run()
+size_t TemperatureRosPublisher::getNrOfSensors() const
 {
-    if (m_publisher.asPort().isOpen())
-    {
-        size_t index = 0;
-        double temperature;
-        yarp::rosmsg::sensor_msgs::Temperature& temp_ros_data = m_publisher.prepare();
-        m_ITemperature->getTemperatureSensorMeasure(index, temperature, m_timestamp);
-        temp_ros_data.clear();
-        temp_ros_data.header.frame_id = m_framename;
-        temp_ros_data.header.seq = m_msg_counter++;
-        temp_ros_data.header.stamp = m_timestamp;
-        temp_ros_data.temperature = temperature;
-        temp_ros_data.variance = 0;
-        m_publisher.write();
+    return m_ITemperature->getNrOfTemperatureSensors();
+}
+
+bool TemperatureRosPublisher::getSensorFrameName(size_t sens_index, std::string& framename) const
+{
+    return m_ITemperature->getTemperatureSensorFrameName(sens_index, framename);
+}
+
+bool TemperatureRosPublisher::readSensor(size_t sens_index, yarp::rosmsg::sensor_msgs::Temperature& temp_ros_data, double& timestamp)
+{
+    double temperature;
+    if (!m_ITemperature->getTemperatureSensorMeasure(sens_index, temperature, timestamp)) {
+        return false;
     }
- }
+    temp_ros_data.temperature = temperature;
+    temp_ros_data.variance = 0;
+    return true;
+}
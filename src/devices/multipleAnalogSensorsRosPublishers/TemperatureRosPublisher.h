@@ -40,10 +40,11 @@ public:
     using GenericSensorRosPublisher<yarp::rosmsg::sensor_msgs::Temperature>::attachAll;
     using GenericSensorRosPublisher<yarp::rosmsg::sensor_msgs::Temperature>::detachAll;
 
-    /* PeriodicRateThread methods */
-    void run() override;
-
+protected:
     bool viewInterfaces() override;
+    size_t getNrOfSensors() const override;
+    bool getSensorFrameName(size_t sens_index, std::string& framename) const override;
+    bool readSensor(size_t sens_index, yarp::rosmsg::sensor_msgs::Temperature& msg, double& timestamp) override;
 };
 
 #endif
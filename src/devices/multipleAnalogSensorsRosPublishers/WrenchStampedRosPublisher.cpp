@@ -16,27 +16,30 @@ bool WrenchStampedRosPublisher::viewInterfaces()
         return false;
     }
 
-    ok = m_iFTsens->getSixAxisForceTorqueSensorFrameName(m_sens_index, m_framename);
-    return ok;
+    return true;
 }
 
-void WrenchStampedRosPublisher::run()
+size_t WrenchStampedRosPublisher::getNrOfSensors() const
 {
-    if (m_publisher.asPort().isOpen())
-    {
-        yarp::sig::Vector vecwrench(6);
-        yarp::rosmsg::geometry_msgs::WrenchStamped& wrench_ros_data = m_publisher.prepare();
-        m_iFTsens->getSixAxisForceTorqueSensorMeasure(m_sens_index, vecwrench, m_timestamp);
-        wrench_ros_data.clear();
-        wrench_ros_data.header.frame_id = m_framename;
-        wrench_ros_data.header.seq = m_msg_counter++;
-        wrench_ros_data.header.stamp = m_timestamp;
-        wrench_ros_data.wrench.force.x = vecwrench[0];
-        wrench_ros_data.wrench.force.y = vecwrench[1];
-        wrench_ros_data.wrench.force.z = vecwrench[2];
-        wrench_ros_data.wrench.torque.x = vecwrench[4];
-        wrench_ros_data.wrench.torque.y = vecwrench[5];
-        wrench_ros_data.wrench.torque.z = vecwrench[6];
-        m_publisher.write();
+    return m_iFTsens->getNrOfSixAxisForceTorqueSensors();
+}
+
+bool WrenchStampedRosPublisher::getSensorFrameName(size_t sens_index, std::string& framename) const
+{
+    return m_iFTsens->getSixAxisForceTorqueSensorFrameName(sens_index, framename);
+}
+
+bool WrenchStampedRosPublisher::readSensor(size_t sens_index, yarp::rosmsg::geometry_msgs::WrenchStamped& wrench_ros_data, double& timestamp)
+{
+    yarp::sig::Vector vecwrench(6);
+    if (!m_iFTsens->getSixAxisForceTorqueSensorMeasure(sens_index, vecwrench, timestamp)) {
+        return false;
     }
+    wrench_ros_data.wrench.force.x = vecwrench[0];
+    wrench_ros_data.wrench.force.y = vecwrench[1];
+    wrench_ros_data.wrench.force.z = vecwrench[2];
+    wrench_ros_data.wrench.torque.x = vecwrench[3];
+    wrench_ros_data.wrench.torque.y = vecwrench[4];
+    wrench_ros_data.wrench.torque.z = vecwrench[5];
+    return true;
 }
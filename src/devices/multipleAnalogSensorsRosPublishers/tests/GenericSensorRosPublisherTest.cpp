@@ -0,0 +1,188 @@
+/*
+ * SPDX-FileCopyrightText: 2006-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "GenericSensorRosPublisher.h"
+
+#include <yarp/dev/PolyDriver.h>
+#include <yarp/dev/PolyDriverList.h>
+#include <yarp/os/Network.h>
+#include <yarp/os/Property.h>
+#include <yarp/os/SystemClock.h>
+#include <yarp/os/Time.h>
+#include <yarp/rosmsg/sensor_msgs/Temperature.h>
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include <catch2/catch_amalgamated.hpp>
+#include <harness.h>
+
+namespace {
+// A sensor producing a new sample every sensorPeriod seconds, timestamped with the system clock
+class SimulatedSensorPublisher : public GenericSensorRosPublisher<yarp::rosmsg::sensor_msgs::Temperature>
+{
+    double m_sensorPeriod;
+
+public:
+    bool failing = false; // every read of the sensor fails
+
+    explicit SimulatedSensorPublisher(double sensorPeriod) :
+        m_sensorPeriod(sensorPeriod)
+    {
+    }
+
+protected:
+    bool viewInterfaces() override { return true; }
+    size_t getNrOfSensors() const override { return 1; }
+    bool getSensorFrameName(size_t sens_index, std::string& framename) const override
+    {
+        framename = "simulated_sensor";
+        return true;
+    }
+    bool readSensor(size_t sens_index, yarp::rosmsg::sensor_msgs::Temperature& msg, double& timestamp) override
+    {
+        if (failing) {
+            return false;
+        }
+        timestamp = std::floor(yarp::os::SystemClock::nowSystem() / m_sensorPeriod) * m_sensorPeriod;
+        msg.temperature = 20.0;
+        msg.variance = 0;
+        return true;
+    }
+};
+
+// Several sensors with the given frame names, in all_sensors mode
+class NamedSensorsPublisher : public GenericSensorRosPublisher<yarp::rosmsg::sensor_msgs::Temperature>
+{
+public:
+    std::vector<std::string> frameNames;
+
+    std::vector<std::string> getTopics() const
+    {
+        std::vector<std::string> topics;
+        for (const auto& out : m_outputs) {
+            topics.push_back(out.topic);
+        }
+        return topics;
+    }
+
+protected:
+    bool viewInterfaces() override { return true; }
+    size_t getNrOfSensors() const override { return frameNames.size(); }
+    bool getSensorFrameName(size_t sens_index, std::string& framename) const override
+    {
+        framename = frameNames[sens_index];
+        return true;
+    }
+    bool readSensor(size_t sens_index, yarp::rosmsg::sensor_msgs::Temperature& msg, double& timestamp) override
+    {
+        timestamp = yarp::os::SystemClock::nowSystem();
+        msg.temperature = 20.0;
+        msg.variance = 0;
+        return true;
+    }
+};
+
+bool attachNamed(NamedSensorsPublisher& pub)
+{
+    yarp::os::Property p_cfg;
+    p_cfg.put("topic", "/sensors");
+    p_cfg.put("period", 0.01);
+    p_cfg.put("all_sensors", yarp::os::Value(true));
+    REQUIRE(pub.open(p_cfg));
+
+    yarp::dev::PolyDriver dummy;
+    yarp::dev::PolyDriverList list;
+    list.push(&dummy, "dummy");
+    return pub.attachAll(list);
+}
+
+SimulatedSensorPublisher::SampleStatistics runFor(SimulatedSensorPublisher& pub, double period, bool skipDuplicates, double sensorPeriod = 0.0)
+{
+    yarp::os::Property p_cfg;
+    p_cfg.put("sensor_period", sensorPeriod);
+    p_cfg.put("topic", "/simulated_sensor");
+    p_cfg.put("period", period);
+    p_cfg.put("skip_duplicates", yarp::os::Value(skipDuplicates));
+    REQUIRE(pub.open(p_cfg));
+
+    // The simulated sensor does not use the attached device
+    yarp::dev::PolyDriver dummy;
+    yarp::dev::PolyDriverList list;
+    list.push(&dummy, "dummy");
+    REQUIRE(pub.attachAll(list));
+    yarp::os::Time::delay(0.5);
+    CHECK(pub.detachAll());
+    SimulatedSensorPublisher::SampleStatistics stats = pub.getSampleStatistics();
+    CHECK(pub.close());
+    return stats;
+}
+} // namespace
+
+TEST_CASE("dev::GenericSensorRosPublisher_Test", "[yarp::dev]")
+{
+    yarp::os::Network::setLocalMode(true);
+
+    SECTION("Sensor slower than the thread: duplicated samples are counted and skipped")
+    {
+        SimulatedSensorPublisher pub(0.02);
+        auto stats = runFor(pub, 0.002, true);
+        INFO("published " << stats.published << ", duplicated " << stats.duplicated << ", dropped " << stats.dropped);
+        CHECK(stats.duplicated > 0);
+        // at most one sample per sensor period is published
+        CHECK(stats.published < stats.duplicated);
+        CHECK(stats.published <= static_cast<size_t>(0.5 / 0.02) + 2);
+    }
+
+    SECTION("Sensor slower than the thread: duplicated samples are published by default")
+    {
+        SimulatedSensorPublisher pub(0.02);
+        auto stats = runFor(pub, 0.002, false);
+        INFO("published " << stats.published << ", duplicated " << stats.duplicated << ", dropped " << stats.dropped);
+        CHECK(stats.duplicated > 0);
+        CHECK(stats.published > stats.duplicated);
+    }
+
+    SECTION("Sensor faster than the thread: dropped samples are counted")
+    {
+        SimulatedSensorPublisher pub(0.001);
+        auto stats = runFor(pub, 0.01, true, 0.001);
+        INFO("published " << stats.published << ", duplicated " << stats.duplicated << ", dropped " << stats.dropped);
+        CHECK(stats.published > 0);
+        CHECK(stats.dropped > stats.published);
+    }
+
+    SECTION("Failing sensor: the failed reads are counted, nothing is published")
+    {
+        SimulatedSensorPublisher pub(0.01);
+        pub.failing = true;
+        auto stats = runFor(pub, 0.01, false);
+        CHECK(stats.failed > 0);
+        CHECK(stats.published == 0);
+        CHECK(stats.duplicated == 0);
+    }
+
+    SECTION("all_sensors: topics named after the frames, without collisions")
+    {
+        NamedSensorsPublisher pub;
+        pub.frameNames = { "/imu", "imu", "left foot", "left_foot", "//head/ft" };
+        REQUIRE(attachNamed(pub));
+        std::vector<std::string> expected = { "/sensors/imu", "/sensors/imu_1", "/sensors/left_foot", "/sensors/left_foot_3", "/sensors/head/ft" };
+        CHECK(pub.getTopics() == expected);
+        CHECK(pub.detachAll());
+        CHECK(pub.close());
+    }
+
+    SECTION("all_sensors: a sensor without frame name is rejected")
+    {
+        NamedSensorsPublisher pub;
+        pub.frameNames = { "imu", "/" };
+        CHECK_FALSE(attachNamed(pub));
+        CHECK(pub.close());
+    }
+
+    yarp::os::Network::setLocalMode(false);
+}
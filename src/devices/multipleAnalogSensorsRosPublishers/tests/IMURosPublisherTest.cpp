@@ -0,0 +1,93 @@
+/*
+ * SPDX-FileCopyrightText: 2006-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "IMURosPublisher.h"
+
+#include <yarp/math/Math.h>
+#include <yarp/math/Quaternion.h>
+#include <yarp/os/LogStream.h>
+#include <yarp/os/Network.h>
+#include <yarp/os/Property.h>
+#include <yarp/os/SystemClock.h>
+
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <catch2/catch_amalgamated.hpp>
+#include <harness.h>
+
+TEST_CASE("dev::IMURosPublisher_Test", "[yarp::dev]")
+{
+    SECTION("Closed form rpy to quaternion matches rpy2dcm")
+    {
+        const double angles[] = { -3.0, -1.2, -0.3, 0.0, 0.4, 1.5, 2.9 };
+        for (double roll : angles) {
+            for (double pitch : angles) {
+                for (double yaw : angles) {
+                    yarp::sig::Vector rpy(3);
+                    rpy[0] = roll;
+                    rpy[1] = pitch;
+                    rpy[2] = yaw;
+                    yarp::math::Quaternion expected;
+                    expected.fromRotationMatrix(yarp::math::rpy2dcm(rpy));
+
+                    yarp::rosmsg::geometry_msgs::Quaternion q;
+                    IMURosPublisher::rpyToQuaternion(roll, pitch, yaw, q);
+
+                    // q and -q represent the same rotation
+                    double dot = q.x * expected.x() + q.y * expected.y() + q.z * expected.z() + q.w * expected.w();
+                    CHECK(std::abs(std::abs(dot) - 1.0) < 1e-9);
+                }
+            }
+        }
+    }
+
+    SECTION("Parallel startup of 20 devices")
+    {
+        yarp::os::Network::setLocalMode(true);
+
+        constexpr size_t devices = 20;
+        for (bool async : {false, true})
+        {
+            std::vector<std::unique_ptr<IMURosPublisher>> publishers;
+            double start = yarp::os::SystemClock::nowSystem();
+            for (size_t i = 0; i < devices; i++)
+            {
+                yarp::os::Property p_cfg;
+                p_cfg.put("topic", "/imu_startup_test_" + std::to_string(i));
+                p_cfg.put("period", 0.01);
+                p_cfg.put("async_registration", yarp::os::Value(async));
+                publishers.push_back(std::make_unique<IMURosPublisher>());
+                REQUIRE(publishers.back()->open(p_cfg));
+            }
+            double opened = yarp::os::SystemClock::nowSystem();
+            size_t registrations = 0;
+            for (auto& pub : publishers)
+            {
+                if (pub->waitForRegistration())
+                {
+                    registrations++;
+                }
+            }
+            double registered = yarp::os::SystemClock::nowSystem();
+
+            // Every device ends up registered, whatever the mode. The timings depend on the
+            // name server and on the load of the machine, they are only printed.
+            CHECK(registrations == devices);
+
+            yInfo() << devices << (async ? "async" : "sync") << "devices: open() of all devices took"
+                    << opened - start << "s, registration completed after" << registered - start << "s";
+
+            for (auto& pub : publishers)
+            {
+                CHECK(pub->close());
+            }
+        }
+
+        yarp::os::Network::setLocalMode(false);
+    }
+}
@@ -111,19 +111,20 @@ bool Odometry2D_nws_ros::open(yarp::os::Searchable &config)
     }
     m_baseFrame = config.find("base_frame").asString();
 
-    m_node = new yarp::os::Node(m_nodeName);
+    m_sharedNode = config.check("shared_node", yarp::os::Value(false)).asBool();
+    m_node = m_sharedNode ? yarp::dev::RosNodeRegistry::acquire(m_nodeName) : new yarp::os::Node(m_nodeName);
     if (m_node == nullptr) {
         yCError(ODOMETRY2D_NWS_ROS) << " opening " << m_nodeName << " Node, check your yarp-ROS network configuration\n";
         return false;
     }
-    if (!rosPublisherPort_odometry.topic(m_topicName)) {
+    if (!rosPublisherPort_odometry.topic(m_sharedNode ? yarp::dev::RosNodeRegistry::topicOnNode(m_topicName, m_nodeName) : m_topicName)) {
         yCError(ODOMETRY2D_NWS_ROS) << " opening " << m_topicName << " Topic, check your yarp-ROS network configuration\n";
         return false;
     }
 
     if (m_enable_publish_tf)
     {
-        if (!rosPublisherPort_tf.topic("/tf")) {
+        if (!rosPublisherPort_tf.topic(m_sharedNode ? yarp::dev::RosNodeRegistry::topicOnNode("/tf", m_nodeName) : "/tf")) {
             yCError(ODOMETRY2D_NWS_ROS) << " opening " << "/tf" << " Topic, check your yarp-ROS network configuration\n";
             return false;
         }
@@ -236,7 +237,11 @@ bool Odometry2D_nws_ros::close()
         {
            rosPublisherPort_tf.close();
         }
-        delete m_node;
+        if (m_sharedNode) {
+            yarp::dev::RosNodeRegistry::release(m_node);
+        } else {
+            delete m_node;
+        }
         m_node = nullptr;
     }
 
@@ -19,6 +19,8 @@
 #include <yarp/rosmsg/nav_msgs/Odometry.h>
 #include <yarp/rosmsg/tf2_msgs/TFMessage.h>
 
+#include <RosNodeRegistry.h>
+
 #ifndef _USE_MATH_DEFINES
 #define _USE_MATH_DEFINES
 #endif
@@ -38,6 +40,7 @@
  * |:-------------------:|:-----------------------:|:-------:|:--------------:|:-------------:|:-----------------------------: |:-------------------------------------------------------:|:-----:|
  * | period              |      -                  | double  | s              |   0.02        | No                             | refresh period of the broadcasted values in s           | default 0.02s |
  * | node_name           |      -                  | string  | -              |   -           | Yes                            | name of the ros node                                    | must begin with an initial '/'     |
+ * | shared_node         |      -                  | bool    | -              |   false       | No                             | share the ros node with the other devices of the process declaring the same node_name | the devices of other plugin libraries are included only on some platforms, see RosNodeRegistry |
  * | topic_name          |      -                  | string  | -              |   -           | Yes                            | name of the topic where the device must publish the data| must begin with an initial '/'     |
  * | odom_frame          |      -                  | string  | -              |   -           | Yes                            | name of the reference frame for odometry                |      |
  * | base_frame          |      -                  | string  | -              |   -           | Yes                            | name of the base frame for odometry                     |      |
@@ -126,7 +129,8 @@ private:
     double m_period{DEFAULT_THREAD_PERIOD};
 
     //ros node
-    yarp::os::Node* m_node;
+    yarp::os::Node* m_node{nullptr};
+    bool m_sharedNode{false}; // node obtained from yarp::dev::RosNodeRegistry
 
     //interfaces
     yarp::dev::PolyDriver m_driver;